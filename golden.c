@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "golden.h"
+
+// One engine's trace of one scenario (grown as needed, reused across scenarios)
+typedef struct {
+    MallEvent* events;
+    int count;
+    int capacity;
+} Trace;
+
+static void trace_append(void* user, const MallEvent* event){
+    Trace* t = (Trace*)user;
+    if(t->count == t->capacity){
+        t->capacity = t->capacity ? 2 * t->capacity : 1024;
+        t->events = (MallEvent*)realloc(t->events, sizeof(MallEvent) * t->capacity);
+        if(!t->events){
+            perror("malloc trace");
+            exit(EXIT_FAILURE);
+        }
+    }
+    t->events[t->count++] = *event;
+}
+
+static unsigned int next_draw(unsigned int* x){
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// Scenarios stay within what the command line accepts, so each one can be rerun by hand
+static void make_scenario(MallConfig* cfg, unsigned int seed){
+    unsigned int x = seed * 2654435761u + 0x9e3779b9u;
+    if(x == 0) x = 1;
+    mallsim_default_config(cfg);
+    cfg->seed = seed;
+    cfg->escalator_steps = 1 + next_draw(&x) % MALLSIM_MAX_STEPS;
+    cfg->initial_customers = next_draw(&x) % 31;
+    cfg->mall_capacity = cfg->initial_customers;
+    cfg->batch_size = (next_draw(&x) % 2) ? 5 : 1 + next_draw(&x) % 8;
+    if(next_draw(&x) % 2){
+        cfg->arrival_seconds = 1 + next_draw(&x) % 200;
+        cfg->arrival_max = 1 + next_draw(&x) % 3;
+        cfg->mall_capacity = 1 + next_draw(&x) % 40;
+    }
+}
+
+static void print_command(const MallConfig* cfg){
+    printf("  rerun: ./project2 %d %d --seed %u --batch %d", cfg->escalator_steps,
+           cfg->initial_customers, cfg->seed, cfg->batch_size);
+    if(cfg->arrival_seconds > 0){
+        printf(" --arrivals %d --arrival-max %d --capacity %d",
+               cfg->arrival_seconds, cfg->arrival_max, cfg->mall_capacity);
+    }
+    printf(" --tick-ms 0\n");
+}
+
+static void print_event(const char* who, int index, const Trace* t){
+    static const char* const kinds[] = { "enter", "board", "finish", "direction" };
+    static const char* const values[] = { "arrived", "waited", "turnaround" };
+    if(index >= t->count){
+        printf("  %-10s #%-6d (end of trace)\n", who, index);
+        return;
+    }
+    const MallEvent* e = &t->events[index];
+    const char* dir = (e->direction==MALLSIM_UP) ? "up" : (e->direction==MALLSIM_DOWN) ? "down" : "idle";
+    if(e->kind < 0 || e->kind > MALLSIM_EVENT_DIRECTION){
+        printf("  %-10s #%-6d t=%-5d unknown event %d\n", who, index, e->time, e->kind);
+    } else if(e->kind == MALLSIM_EVENT_DIRECTION){
+        printf("  %-10s #%-6d t=%-5d %-9s %-4s after %d boardings\n", who, index, e->time,
+               kinds[e->kind], dir, e->value);
+    } else {
+        printf("  %-10s #%-6d t=%-5d %-9s %-4s customer %d, %s %d\n", who, index, e->time,
+               kinds[e->kind], dir, e->customer, values[e->kind], e->value);
+    }
+}
+
+static int same_event(const MallEvent* a, const MallEvent* b){
+    return a->time == b->time && a->kind == b->kind && a->customer == b->customer &&
+           a->direction == b->direction && a->value == b->value;
+}
+
+// First event at which the traces differ, -1 if they are equal
+static int first_divergence(const Trace* ref, const Trace* cand){
+    int n = (ref->count < cand->count) ? ref->count : cand->count;
+    for(int i=0; i<n; i++){
+        if(!same_event(&ref->events[i], &cand->events[i])) return i;
+    }
+    return (ref->count == cand->count) ? -1 : n;
+}
+
+// The result fields the reference fills in
+static int same_result(const MallResult* a, const MallResult* b){
+    return a->ticks == b->ticks && a->completed == b->completed && a->remaining == b->remaining &&
+           a->total_turnaround == b->total_turnaround && a->total_wait == b->total_wait &&
+           a->checksum == b->checksum && a->arrivals == b->arrivals &&
+           a->admitted == b->admitted && a->rejected == b->rejected;
+}
+
+static double seconds_since(const struct timespec* start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int golden_check(const char* name, GoldenEngine engine, int scenarios, unsigned int seed){
+    Trace traces[2] = { { NULL, 0, 0 }, { NULL, 0, 0 } };
+    MallResult* results = (MallResult*)malloc(sizeof(MallResult) * 2);
+    if(!results){
+        perror("malloc results");
+        exit(EXIT_FAILURE);
+    }
+    double secs[2] = { 0.0, 0.0 };
+    long events = 0;
+    int diverged = 0;
+
+    printf("===== Golden Traces: reference vs. %s =====\n", name);
+    for(int k=0; k<scenarios; k++){
+        MallConfig cfg;
+        make_scenario(&cfg, seed + (unsigned int)k);
+        for(int e=0; e<2; e++){
+            struct timespec start;
+            traces[e].count = 0;
+            cfg.trace = trace_append;
+            cfg.trace_user = &traces[e];
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            int rc = e ? engine(&cfg, &results[1]) : mallsim_reference_run(&cfg, &results[0]);
+            secs[e] += seconds_since(&start);
+            if(rc != 0){
+                fprintf(stderr, "Error: %s cannot run scenario %d.\n", e ? name : "reference", k);
+                exit(EXIT_FAILURE);
+            }
+        }
+        events += traces[0].count;
+
+        int at = first_divergence(&traces[0], &traces[1]);
+        if(at < 0 && same_result(&results[0], &results[1])) continue;
+        if(++diverged > GOLDEN_REPORTS) continue;
+        printf("Scenario %d (seed %u):", k, cfg.seed);
+        if(at < 0){
+            printf(" traces agree, results differ (ticks %d/%d, completed %d/%d, turnaround %ld/%ld, wait %ld/%ld, rejected %d/%d)\n",
+                   results[0].ticks, results[1].ticks, results[0].completed, results[1].completed,
+                   results[0].total_turnaround, results[1].total_turnaround,
+                   results[0].total_wait, results[1].total_wait, results[0].rejected, results[1].rejected);
+        } else {
+            printf(" first divergence at event %d of %d/%d\n", at, traces[0].count, traces[1].count);
+            for(int i=(at > GOLDEN_CONTEXT ? at - GOLDEN_CONTEXT : 0); i<at; i++){
+                print_event("both", i, &traces[0]);
+            }
+            print_event("reference", at, &traces[0]);
+            print_event(name, at, &traces[1]);
+        }
+        print_command(&cfg);
+    }
+
+    printf("Scenarios: %d (seeds %u..%u), %ld reference events\n",
+           scenarios, seed, seed + (unsigned int)scenarios - 1, events);
+    printf("Time: reference %.3f sec, %s %.3f sec\n", secs[0], name, secs[1]);
+    if(diverged){
+        printf("%d of %d scenarios diverge%s\n", diverged, scenarios,
+               diverged > GOLDEN_REPORTS ? " (first ones shown)" : "");
+    } else {
+        printf("All traces agree\n");
+    }
+    free(traces[0].events);
+    free(traces[1].events);
+    free(results);
+    return diverged;
+}
@@ -0,0 +1,25 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include "mallsim.h"
+
+/*
+ * Differential trace harness: runs the reference engine (mallsim_reference_run) and a
+ * candidate engine on the same seeded scenarios and compares their event traces
+ * (MallConfig.trace) event by event, then their results. For each scenario that differs
+ * it prints the first divergence with the events leading up to it and the command line
+ * that reproduces the scenario.
+ *
+ * Scenario k uses seed + k: a random escalator length, 0-30 customers present at the
+ * start and batch size, and for half of them timed arrivals into a mall of random capacity.
+ */
+#define GOLDEN_CONTEXT 4   // Matching events shown before a divergence
+#define GOLDEN_REPORTS 5   // Divergent scenarios described in full
+
+// A candidate engine: runs cfg to the end, tracing through cfg->trace; -1 if it cannot run cfg
+typedef int (*GoldenEngine)(const MallConfig* cfg, MallResult* out);
+
+// Returns the number of scenarios on which the candidate differs from the reference
+int golden_check(const char* name, GoldenEngine engine, int scenarios, unsigned int seed);
+
+#endif
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "mallsim.h"
+
+// Replication r of every variant, run as one task each
+typedef struct {
+    const MallConfig* variants;
+    int num_variants;
+    const MallCompareSpec* spec;
+    MallArrivals** streams;   // One per replication of the round (common random numbers)
+    int first;                // First replication of the round
+    int num_tasks;            // Replications of the round x variants
+    int next;                 // Next task, taken with an atomic increment
+    double* wait;             // [variant * replications + replication]
+    double* turnaround;
+    int failed;               // Memory ran out in a run or a worker
+} CompareRound;
+
+static void* compare_worker(void* arg){
+    CompareRound* cr = (CompareRound*)arg;
+    MallResult* r = (MallResult*)malloc(sizeof(MallResult));
+    if(!r){
+        __atomic_store_n(&cr->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    int i;
+    while((i = __atomic_fetch_add(&cr->next, 1, __ATOMIC_RELAXED)) < cr->num_tasks){
+        int v = i % cr->num_variants;
+        int rep = cr->first + i / cr->num_variants;
+        MallConfig cfg = cr->variants[v];
+        cfg.log = NULL;
+        cfg.flight_log = NULL;
+        cfg.records = NULL;
+        cfg.trace = NULL;
+        cfg.windows = NULL;
+        cfg.profile = NULL;
+        if(cr->spec->common){
+            cfg.seed += (unsigned int)rep;
+            cfg.arrival_stream = cr->streams[i / cr->num_variants];
+        } else {
+            cfg.seed += (unsigned int)(v * cr->spec->replications + rep);
+            cfg.arrival_stream = NULL;
+        }
+        if(mallsim_run(&cfg, r) != 0){
+            __atomic_store_n(&cr->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        int k = v * cr->spec->replications + rep;
+        cr->wait[k] = r->counters.boarded ? (double)r->total_wait / r->counters.boarded : 0.0;
+        cr->turnaround[k] = r->completed ? (double)r->total_turnaround / r->completed : 0.0;
+    }
+    free(r);
+    return NULL;
+}
+
+// With fewer threads than asked for (none at all, even), the calling thread takes the rest
+static void run_round(CompareRound* cr, int threads){
+    cr->next = 0;
+    if(threads > cr->num_tasks) threads = cr->num_tasks;
+    pthread_t* tids = (threads > 1) ? (pthread_t*)malloc(sizeof(pthread_t) * threads) : NULL;
+    int started = 0;
+    while(tids && started < threads && pthread_create(&tids[started], NULL, compare_worker, cr) == 0){
+        started++;
+    }
+    if(started == 0) compare_worker(cr);
+    for(int t=0; t<started; t++){
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+}
+
+// Variant v against variant 0: the mean difference and its 95% half-width; -1 if out of memory
+static int difference(const double* a, const double* b, int n, int paired, double* diff, double* half){
+    if(paired){
+        double* d = (double*)malloc(sizeof(double) * n);
+        if(!d) return -1;
+        for(int i=0; i<n; i++) d[i] = b[i] - a[i];
+        mallsim_mean_halfwidth(d, n, diff, half);
+        free(d);
+        return 0;
+    }
+    // Independent samples: the variances add (n-1 degrees of freedom, on the safe side)
+    double mean_a, half_a, mean_b, half_b;
+    mallsim_mean_halfwidth(a, n, &mean_a, &half_a);
+    mallsim_mean_halfwidth(b, n, &mean_b, &half_b);
+    *diff = mean_b - mean_a;
+    *half = sqrt(half_a * half_a + half_b * half_b);
+    return 0;
+}
+
+void mallsim_default_compare(MallCompareSpec* spec){
+    memset(spec, 0, sizeof(*spec));
+    spec->replications = 32;
+    spec->common = 1;
+    spec->threads = 1;
+}
+
+/*
+ * Replications go in rounds of one per thread (at least one): the round's arrival streams
+ * are drawn first, then every variant of every replication in the round is a task, so the
+ * variants reading a stream run side by side and the stream is freed once the round is over.
+ */
+int mallsim_compare(const MallConfig* variants, int num_variants, const MallCompareSpec* spec, MallVariantResult* out){
+    if(num_variants < 1 || spec->replications < 2 || spec->threads < 1) return -1;
+    for(int v=0; v<num_variants; v++){
+        if(mallsim_check_config(&variants[v]) || variants[v].seed != variants[0].seed ||
+           variants[v].initial_customers != variants[0].initial_customers ||
+           variants[v].arrival_seconds != variants[0].arrival_seconds ||
+           variants[v].arrival_max != variants[0].arrival_max){
+            return -1;
+        }
+    }
+    memset(out, 0, sizeof(MallVariantResult) * num_variants);
+
+    int reps = spec->replications;
+    CompareRound cr;
+    cr.variants = variants;
+    cr.num_variants = num_variants;
+    cr.spec = spec;
+    cr.streams = (MallArrivals**)calloc(spec->threads, sizeof(MallArrivals*));
+    cr.wait = (double*)malloc(sizeof(double) * 2 * num_variants * reps);
+    cr.failed = !cr.streams || !cr.wait;
+    cr.turnaround = cr.wait ? cr.wait + num_variants * reps : NULL;
+
+    for(cr.first=0; !cr.failed && cr.first<reps; cr.first+=spec->threads){
+        int round = (reps - cr.first < spec->threads) ? reps - cr.first : spec->threads;
+        if(spec->common){
+            for(int r=0; r<round; r++){
+                MallConfig cfg = variants[0];
+                cfg.seed += (unsigned int)(cr.first + r);
+                cr.streams[r] = mallsim_arrivals_create(&cfg);
+                if(!cr.streams[r]) cr.failed = 1;
+            }
+        }
+        cr.num_tasks = round * num_variants;
+        if(!cr.failed) run_round(&cr, spec->threads);
+        if(spec->common){
+            for(int r=0; r<round; r++){
+                mallsim_arrivals_destroy(cr.streams[r]);
+                cr.streams[r] = NULL;
+            }
+        }
+    }
+
+    for(int v=0; !cr.failed && v<num_variants; v++){
+        const double* wait = cr.wait + v * reps;
+        const double* turnaround = cr.turnaround + v * reps;
+        MallVariantResult* res = &out[v];
+        mallsim_mean_halfwidth(wait, reps, &res->wait_mean, &res->wait_half);
+        mallsim_mean_halfwidth(turnaround, reps, &res->turnaround_mean, &res->turnaround_half);
+        if(v == 0) continue;
+        if(difference(cr.wait, wait, reps, spec->common, &res->wait_diff, &res->wait_diff_half) != 0 ||
+           difference(cr.turnaround, turnaround, reps, spec->common, &res->turnaround_diff, &res->turnaround_diff_half) != 0){
+            cr.failed = 1;
+        }
+    }
+
+    free(cr.wait);
+    free(cr.streams);
+    if(cr.failed){
+        memset(out, 0, sizeof(MallVariantResult) * num_variants);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include <string.h>
+#include <math.h>
+
+#include "mallsim.h"
+
+/*
+ * Analytic approximation of the reversible escalator under the batch-switching policy.
+ * Everything is in ticks (seconds). One tick is one boarding per direction, a ride takes
+ * 'steps' ticks, and the first opposite boarding comes 'steps' ticks after the last
+ * boarding of a batch (the escalator has to empty first).
+ */
+
+// Per-direction arrivals per tick: n ~ uniform 0..max, each of them up or down with p = 1/2
+static double direction_rate(int max){
+    return max / 4.0;
+}
+
+// P(no arrival of one direction in a tick)
+static double direction_idle(int max){
+    double sum = 0.0, p = 1.0;
+    for(int n=0; n<=max; n++, p *= 0.5) sum += p;
+    return sum / (max + 1);
+}
+
+/*
+ * One closed-mall drain with 'up' and 'down' customers, all queued at time 0. The phases
+ * alternate; a phase boards a batch on consecutive ticks (or everybody left, once the
+ * opposite queue is empty) and the next phase starts 'steps' ticks after its last boarding.
+ * A one-step escalator empties before every boarding, so its batch count never builds up:
+ * with batches above 1 the up queue simply goes first.
+ */
+static void drain_phases(int up, int down, int L, int B, double* ticks, double* wait, int* switches){
+    int left[2] = { up, down };
+    int dir = (up > 0) ? 0 : 1;
+    double t = 0.0;
+    *wait = 0.0;
+    *switches = 0;
+    while(left[0] + left[1] > 0){
+        int n = left[dir];
+        if(left[1 - dir] > 0 && n > B && (L > 1 || B == 1)) n = B;
+        *wait += n * t + n * (n - 1) / 2.0;   // The i-th of the batch boards at t + i
+        left[dir] -= n;
+        t += n - 1 + L;
+        if(left[1 - dir] > 0){
+            dir = 1 - dir;
+            (*switches)++;
+        }
+    }
+    *ticks = t + 1;                          // Last ride ends at t; ticks count from 0
+}
+
+// Closed mall: the expected drain over the binomial split of the initial customers
+static void estimate_closed(const MallConfig* cfg, MallEstimate* out){
+    int N = cfg->initial_customers;
+    out->regime = MALLSIM_REGIME_CLOSED;
+    out->batch = cfg->batch_size;
+    if(N == 0) return;
+    double weight = pow(0.5, N);             // C(N, 0) / 2^N
+    double wait_sum = 0.0;
+    for(int up=0; up<=N; up++){
+        double ticks, wait;
+        int switches;
+        drain_phases(up, N - up, cfg->escalator_steps, cfg->batch_size, &ticks, &wait, &switches);
+        out->makespan += weight * ticks;
+        out->throughput += weight * N / ticks;
+        out->switch_rate += weight * switches / ticks;
+        wait_sum += weight * wait;
+        weight = weight * (N - up) / (up + 1);
+    }
+    out->mean_wait = wait_sum / N;
+}
+
+// Mean number in an M/M/1/K queue of load rho, and the share of arrivals that find it full
+static double finite_queue(double rho, double K, double* full){
+    if(fabs(rho - 1.0) < 1e-9){
+        *full = 1.0 / (K + 1.0);
+        return K / 2.0;
+    }
+    double rk = pow(rho, K), rk1 = rk * rho;
+    *full = (1.0 - rho) * rk / (1.0 - rk1);
+    return rho / (1.0 - rho) - (K + 1.0) * rk1 / (1.0 - rk1);
+}
+
+/*
+ * Open mall, arrivals split evenly, a = arrivals per tick per direction.
+ *
+ * Saturated when a direction gets at least a full batch per cycle with full batches on
+ * both sides (cycle 2 * (batch - 1 + steps)). Each queue is then treated as a finite
+ * queue of that load, with room for the mall capacity less the riders (plus the holding
+ * buffer when arrivals may wait outside), which gives the losses and, by Little's law,
+ * the wait.
+ *
+ * A one-step escalator needs no switch-over at all: it is a single queue of both
+ * directions served once per tick, with the discrete-time mean queue length.
+ *
+ * Otherwise the symmetric half-cycle H is found by fixed-point iteration on
+ *   backlog       Q = a * A, cleared in tau = Q / (1 - a) boardings
+ *   extra riders  while the batch is not full, each next arrival within steps-1 ticks of
+ *                 the previous boarding still rides in this direction (probability q)
+ *   away time     A = steps + H if the batch filled up, H + 1 if the direction ran dry
+ *   half-cycle    H = span of the boardings + steps
+ * and the wait is the fluid backlog triangle plus the tick every arrival waits anyway.
+ */
+static void estimate_open(const MallConfig* cfg, MallEstimate* out){
+    int L = cfg->escalator_steps, B = cfg->batch_size;
+    double a = direction_rate(cfg->arrival_max);
+    double z = direction_idle(cfg->arrival_max);
+
+    double full_cycle = 2.0 * (B - 1 + L);
+    double mu = (L == 1) ? 0.5 : B / full_cycle;     // Most boardings per tick per direction
+    if(a >= mu){
+        out->regime = MALLSIM_REGIME_SATURATED;
+        out->cycle = full_cycle;
+        out->batch = B;
+        double room = (cfg->mall_capacity - 2.0 * mu * L) / 2.0;
+        if(room < 1.0) room = 1.0;
+        if(cfg->overflow_policy == MALLSIM_OVERFLOW_DEFER){
+            room += cfg->holding_buffer;
+        } else if(cfg->overflow_policy == MALLSIM_OVERFLOW_SHED){
+            room += cfg->holding_buffer / 2.0;       // Shedding keeps the buffer about half full
+        }
+        double queued = finite_queue(a / mu, room, &out->loss);
+        out->throughput = 2.0 * a * (1.0 - out->loss);
+        out->mean_wait = queued / (a * (1.0 - out->loss));
+        if(L > 1) out->switch_rate = 2.0 / full_cycle;
+        else out->switch_rate = (B == 1) ? out->throughput : a;   // Batches of 1 alternate every tick
+        return;
+    }
+
+    out->regime = MALLSIM_REGIME_STABLE;
+    out->throughput = 2.0 * a;
+    if(L == 1){
+        int M = cfg->arrival_max;
+        double lambda = 2.0 * a;
+        double var = ((M + 1.0) * (M + 1.0) - 1.0) / 12.0;
+        out->mean_wait = (lambda - lambda * lambda + var) / (2.0 * (1.0 - lambda)) / lambda;
+        out->switch_rate = a;                        // Consecutive riders differ half the time
+        out->cycle = 2.0 / lambda;
+        out->batch = 1.0;
+        return;
+    }
+
+    double q = 1.0 - pow(z, L - 1);                  // Next arrival soon enough to ride along
+    double gap = 0.0;                                // Mean gap given that it is soon enough
+    if(q > 0.0){
+        double pz = 1.0;
+        for(int j=1; j<L; j++, pz *= z) gap += j * (1.0 - z) * pz;
+        gap /= q;
+    }
+
+    double H = L, A = L, tau = 0.0, Q = 0.0, extra = 0.0;
+    for(int it=0; it<1000; it++){
+        Q = a * A;
+        tau = Q / (1.0 - a);
+        if(tau > B) tau = B;
+        double room = B - tau;
+        double filled = pow(q, room);                // Every remaining place taken
+        extra = (q >= 1.0) ? room : q * (1.0 - filled) / (1.0 - q);
+        double span = (tau > 1.0 ? tau - 1.0 : 0.0) + extra * gap;
+        double next = span + L;
+        double next_away = filled * (L + next) + (1.0 - filled) * (next + 1.0);
+        if(fabs(next - H) < 1e-9 && fabs(next_away - A) < 1e-9) break;
+        H = 0.5 * (H + next);
+        A = 0.5 * (A + next_away);
+    }
+
+    double cycle = 2.0 * H;
+    out->cycle = cycle;
+    out->batch = tau + extra;
+    double backlog_area = 0.5 * Q * (A + tau);       // Customer-ticks queued per direction per cycle
+    out->mean_wait = 1.0 + backlog_area / (a * cycle);
+    out->switch_rate = 2.0 / cycle;
+}
+
+int mallsim_estimate(const MallConfig* cfg, MallEstimate* out){
+    memset(out, 0, sizeof(*out));
+    if(mallsim_check_config(cfg) || cfg->pair || cfg->lanes == 2) return -1;
+    // None of the models knows impatient customers, priority classes, stops or a wait bound
+    if(cfg->balk_length > 0 || cfg->patience > 0 || cfg->classes > 1 || cfg->wait_bound > 0 ||
+       cfg->outage_length > 0 || cfg->breakdown_mtbf > 0){
+        return -1;
+    }
+    if(cfg->arrival_seconds > 0 && cfg->arrival_max > 0){
+        estimate_open(cfg, out);
+    } else {
+        estimate_closed(cfg, out);
+    }
+    out->mean_turnaround = out->mean_wait + cfg->escalator_steps;
+    return 0;
+}
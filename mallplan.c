@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "mallsim.h"
+
+// Where a candidate stands after its latest round
+#define PLAN_OPEN      0   // Needs more replications
+#define PLAN_FEASIBLE  1   // Whole 95% interval meets the target
+#define PLAN_PRUNED    2   // Whole 95% interval misses it (or cannot beat a feasible candidate)
+#define PLAN_UNDECIDED 3   // Out of replications without a confident verdict
+
+typedef struct {
+    MallConfig cfg;
+    double* p99;      // Per replication
+    double* loss;
+    int done;         // Replications finished
+    int state;
+    double p99_mean, p99_half;
+    double loss_mean, loss_half;
+} Candidate;
+
+// One round: every open candidate gets its next 'round' replications
+typedef struct {
+    Candidate** cands;
+    int* task_cand;
+    int* task_rep;
+    int num_tasks;
+    int next;         // Next task, taken with an atomic increment
+    unsigned int seed;
+    int failed;       // Memory ran out in a run or a worker
+} PlanRound;
+
+static void* plan_worker(void* arg){
+    PlanRound* pr = (PlanRound*)arg;
+    MallResult* r = (MallResult*)malloc(sizeof(MallResult));
+    if(!r){
+        __atomic_store_n(&pr->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    int i;
+    while((i = __atomic_fetch_add(&pr->next, 1, __ATOMIC_RELAXED)) < pr->num_tasks){
+        Candidate* c = pr->cands[pr->task_cand[i]];
+        int rep = pr->task_rep[i];
+        MallConfig cfg = c->cfg;
+        cfg.seed = pr->seed + (unsigned int)rep;   // Same seeds for every candidate
+        if(mallsim_run(&cfg, r) != 0){
+            __atomic_store_n(&pr->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        c->p99[rep] = mallsim_percentile(r->wait_hist, 99);
+        c->loss[rep] = r->arrivals ? (double)(r->rejected + r->shed) / r->arrivals : 0.0;
+    }
+    free(r);
+    return NULL;
+}
+
+// With fewer threads than asked for (none at all, even), the calling thread takes the rest
+static void run_round(PlanRound* pr, int threads){
+    pr->next = 0;
+    if(threads > pr->num_tasks) threads = pr->num_tasks;
+    pthread_t* tids = (threads > 1) ? (pthread_t*)malloc(sizeof(pthread_t) * threads) : NULL;
+    int started = 0;
+    while(tids && started < threads && pthread_create(&tids[started], NULL, plan_worker, pr) == 0){
+        started++;
+    }
+    if(started == 0) plan_worker(pr);
+    for(int t=0; t<started; t++){
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+}
+
+static void judge(Candidate* c, const MallPlanSpec* spec){
+    mallsim_mean_halfwidth(c->p99, c->done, &c->p99_mean, &c->p99_half);
+    mallsim_mean_halfwidth(c->loss, c->done, &c->loss_mean, &c->loss_half);
+    if(c->p99_mean - c->p99_half > spec->target_p99 || c->loss_mean - c->loss_half > spec->max_loss){
+        c->state = PLAN_PRUNED;
+    } else if(c->p99_mean + c->p99_half <= spec->target_p99 && c->loss_mean + c->loss_half <= spec->max_loss){
+        c->state = PLAN_FEASIBLE;
+    } else if(c->done >= spec->replications){
+        c->state = PLAN_UNDECIDED;
+    }
+}
+
+// Preference among feasible candidates of one length: larger capacity, then lower p99
+static int better(const Candidate* a, const Candidate* b){
+    if(!b) return 1;
+    if(a->cfg.mall_capacity != b->cfg.mall_capacity) return a->cfg.mall_capacity > b->cfg.mall_capacity;
+    return a->p99_mean < b->p99_mean;
+}
+
+void mallsim_default_plan(MallPlanSpec* spec){
+    memset(spec, 0, sizeof(*spec));
+    spec->steps_min = 1;
+    spec->steps_max = MALLSIM_MAX_STEPS;
+    spec->capacity_min = 10;
+    spec->capacity_max = 60;
+    spec->capacity_step = 5;
+    spec->batch_min = 1;
+    spec->batch_max = 10;
+    spec->target_p99 = 60.0;
+    spec->max_loss = 0.05;
+    spec->replications = 32;
+    spec->round = 4;
+    spec->threads = 1;
+}
+
+/*
+ * Escalator lengths are tried from the cheapest up and the search stops at the first
+ * length with a feasible candidate. Within a length all capacity x batch candidates run
+ * their rounds together (one task per replication, spread over the threads); after every
+ * round hopeless candidates are dropped, and so is every candidate with a smaller capacity
+ * than one already accepted, since it could not be preferred.
+ */
+int mallsim_plan(const MallConfig* base, const MallPlanSpec* spec, MallPlanResult* out){
+    memset(out, 0, sizeof(*out));
+    if(mallsim_check_config(base) || spec->steps_min < 1 || spec->steps_max > MALLSIM_MAX_STEPS ||
+       spec->steps_min > spec->steps_max || spec->batch_min < 1 || spec->batch_min > spec->batch_max ||
+       spec->replications < 2 || spec->round < 2 || spec->threads < 1){
+        return -1;
+    }
+    // Capacity only matters when customers keep arriving
+    int cap_min = base->mall_capacity, cap_max = base->mall_capacity, cap_step = 1;
+    if(base->arrival_seconds > 0){
+        if(spec->capacity_min < 1 || spec->capacity_min > spec->capacity_max || spec->capacity_step < 1) return -1;
+        cap_min = spec->capacity_min;
+        cap_max = spec->capacity_max;
+        cap_step = spec->capacity_step;
+    }
+    int num_caps = (cap_max - cap_min) / cap_step + 1;
+    int num = num_caps * (spec->batch_max - spec->batch_min + 1);
+
+    Candidate* cands = (Candidate*)calloc(num, sizeof(Candidate));
+    Candidate** open = (Candidate**)malloc(sizeof(Candidate*) * num);
+    double* samples = (double*)malloc(sizeof(double) * 2 * num * spec->replications);
+    PlanRound pr;
+    pr.task_cand = (int*)malloc(sizeof(int) * num * spec->round);
+    pr.task_rep = (int*)malloc(sizeof(int) * num * spec->round);
+    pr.seed = base->seed;
+    pr.failed = 0;
+    pr.cands = open;
+
+    int failed = !cands || !open || !samples || !pr.task_cand || !pr.task_rep;
+    for(int steps=spec->steps_min; steps<=spec->steps_max && !out->found && !failed; steps++){
+        int k = 0;
+        for(int cap=cap_min; cap<=cap_max; cap+=cap_step){
+            for(int batch=spec->batch_min; batch<=spec->batch_max; batch++, k++){
+                Candidate* c = &cands[k];
+                c->cfg = *base;
+                c->cfg.escalator_steps = steps;
+                c->cfg.mall_capacity = cap;
+                c->cfg.batch_size = batch;
+                c->cfg.log = NULL;
+                c->cfg.flight_log = NULL;
+                c->cfg.records = NULL;
+                c->cfg.trace = NULL;
+                c->cfg.windows = NULL;
+                c->cfg.arrival_stream = NULL;
+                c->cfg.profile = NULL;
+                c->p99 = samples + (size_t)2 * k * spec->replications;
+                c->loss = c->p99 + spec->replications;
+                c->done = 0;
+                c->state = PLAN_OPEN;
+            }
+        }
+        out->levels++;
+        out->candidates += num;
+
+        Candidate* best = NULL;
+        while(1){
+            int num_open = 0;
+            pr.num_tasks = 0;
+            for(int i=0; i<num; i++){
+                Candidate* c = &cands[i];
+                if(c->state != PLAN_OPEN) continue;
+                if(best && c->cfg.mall_capacity < best->cfg.mall_capacity){
+                    c->state = PLAN_PRUNED;
+                    out->pruned++;
+                    continue;
+                }
+                open[num_open] = c;
+                int reps = spec->round;
+                if(c->done + reps > spec->replications) reps = spec->replications - c->done;
+                for(int r=0; r<reps; r++){
+                    pr.task_cand[pr.num_tasks] = num_open;
+                    pr.task_rep[pr.num_tasks++] = c->done + r;
+                }
+                num_open++;
+            }
+            if(num_open == 0) break;
+
+            run_round(&pr, spec->threads);
+            if(pr.failed){
+                failed = 1;
+                break;
+            }
+            out->runs += pr.num_tasks;
+            for(int i=0; i<num_open; i++){
+                Candidate* c = open[i];
+                c->done += (c->done + spec->round > spec->replications) ? spec->replications - c->done : spec->round;
+                judge(c, spec);
+                if(c->state == PLAN_PRUNED && c->done < spec->replications) out->pruned++;
+                if(c->state == PLAN_FEASIBLE && better(c, best)) best = c;
+            }
+        }
+
+        if(best){
+            out->found = 1;
+            out->best = best->cfg;
+            out->best.seed = base->seed;
+            out->best.log = base->log;
+            out->best.log_user = base->log_user;
+            out->best.flight_log = base->flight_log;
+            out->best.records = base->records;
+            out->best.trace = base->trace;
+            out->best.windows = base->windows;
+            out->best.arrival_stream = base->arrival_stream;
+            out->best.profile = base->profile;
+            out->replications = best->done;
+            out->p99_mean = best->p99_mean;
+            // Neither a p99 nor a share can be negative, nor a share above 1
+            out->p99_low = fmax(best->p99_mean - best->p99_half, 0.0);
+            out->p99_high = best->p99_mean + best->p99_half;
+            out->loss_mean = best->loss_mean;
+            out->loss_low = fmax(best->loss_mean - best->loss_half, 0.0);
+            out->loss_high = fmin(best->loss_mean + best->loss_half, 1.0);
+        }
+    }
+
+    free(pr.task_cand);
+    free(pr.task_rep);
+    free(samples);
+    free(open);
+    free(cands);
+    if(failed){
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mallsim.h"
+
+/*
+ * Reference engine: the control loop of sample7.c/sample8.c as they were first written,
+ * minus the threads, the locks and the printing, for checking mallsim.c (and whatever
+ * engine comes after it) against. Nothing here is meant to be fast and nothing should be
+ * made fast: the queues are plain linked lists, the riders are shifted one step at a time
+ * and the customers come from rand(), whose sequence mallsim.c reproduces. Where the
+ * original printed a line worth keeping, an event is traced.
+ *
+ * The one part not kept verbatim is the arrival of timed customers, which follows the
+ * admission rules sample7.c has had since: every arrival draws its direction, and one
+ * that finds the mall full is turned away (MALLSIM_OVERFLOW_REJECT).
+ */
+
+#define UP    MALLSIM_UP
+#define DOWN  MALLSIM_DOWN
+#define IDLE  MALLSIM_IDLE
+
+typedef struct RefCustomer {
+    int id;
+    int arrival_time;
+    int direction;
+    struct RefCustomer* next;
+} RefCustomer;
+
+typedef struct {
+    RefCustomer* head;
+    RefCustomer* tail;
+    int length;
+} RefQueue;
+
+typedef struct {
+    const MallConfig* cfg;
+    MallResult* out;
+    RefQueue upQueue;
+    RefQueue downQueue;
+    RefCustomer* steps[MALLSIM_MAX_STEPS];
+    int direction;
+    int num_people;
+    int current_dir_boarded_count;
+    int total_customers;
+    int current_time;
+    int last_id;
+    int out_of_memory;
+} RefMall;
+
+static void ref_trace(RefMall* m, int kind, int customer, int direction, int value){
+    if(!m->cfg->trace) return;
+    MallEvent ev = { m->current_time, kind, customer, direction, value };
+    m->cfg->trace(m->cfg->trace_user, &ev);
+}
+
+static void ref_enqueue(RefMall* m, RefQueue* q, RefCustomer* c){
+    if(!q->head){
+        q->head = c;
+    } else {
+        q->tail->next = c;
+    }
+    q->tail = c;
+    q->length++;
+    ref_trace(m, MALLSIM_EVENT_ENTER, c->id, c->direction, c->arrival_time);
+}
+
+static RefCustomer* ref_dequeue(RefQueue* q){
+    RefCustomer* c = q->head;
+    q->head = c->next;
+    if(!q->head) q->tail = NULL;
+    q->length--;
+    return c;
+}
+
+static void ref_create_customer(RefMall* m, int direction){
+    RefCustomer* c = (RefCustomer*)malloc(sizeof(RefCustomer));
+    if(!c){
+        m->out_of_memory = 1;
+        return;
+    }
+    c->id = ++m->last_id;
+    c->arrival_time = m->current_time;
+    c->direction = direction;
+    c->next = NULL;
+    ref_enqueue(m, (direction==UP)? &m->upQueue : &m->downQueue, c);
+    m->total_customers++;
+}
+
+static int ref_can_board(RefMall* m, RefCustomer* c){
+    if(m->num_people >= m->cfg->escalator_steps) return 0;
+    if(m->direction == IDLE){
+        m->direction = c->direction;
+        ref_trace(m, MALLSIM_EVENT_DIRECTION, 0, m->direction, m->current_dir_boarded_count);
+        m->current_dir_boarded_count = 0;
+        return 1;
+    }
+    if(m->direction == c->direction){
+        RefQueue* oppQ = (c->direction==UP)? &m->downQueue : &m->upQueue;
+        if(oppQ->length>0 && m->current_dir_boarded_count>=m->cfg->batch_size) return 0;
+        return 1;
+    }
+    return 0;
+}
+
+static void ref_board(RefMall* m, RefCustomer* c){
+    int entry = (c->direction==UP)? 0 : (m->cfg->escalator_steps - 1);
+    m->steps[entry] = c;
+    m->num_people++;
+    m->current_dir_boarded_count++;
+    int wait_time = m->current_time - c->arrival_time;
+    m->out->total_wait += wait_time;
+    ref_trace(m, MALLSIM_EVENT_BOARD, c->id, c->direction, wait_time);
+}
+
+static void ref_disembark(RefMall* m, int step){
+    RefCustomer* c = m->steps[step];
+    int tat = m->current_time - c->arrival_time;
+    m->out->total_turnaround += tat;
+    m->out->completed++;
+    m->out->checksum = m->out->checksum * 1000003UL + (unsigned long)c->id * 131UL + (unsigned long)tat;
+    ref_trace(m, MALLSIM_EVENT_FINISH, c->id, c->direction, tat);
+    free(c);
+    m->steps[step] = NULL;
+    m->num_people--;
+    m->total_customers--;
+}
+
+static void ref_operate(RefMall* m){
+    int steps = m->cfg->escalator_steps;
+    if(m->num_people==0) return;
+    if(m->direction==UP){
+        if(m->steps[steps-1]) ref_disembark(m, steps-1);
+        for(int i=steps-2; i>=0; i--){
+            if(m->steps[i]){
+                m->steps[i+1]=m->steps[i];
+                m->steps[i]=NULL;
+            }
+        }
+    } else if(m->direction==DOWN){
+        if(m->steps[0]) ref_disembark(m, 0);
+        for(int i=1; i<steps; i++){
+            if(m->steps[i]){
+                m->steps[i-1]=m->steps[i];
+                m->steps[i]=NULL;
+            }
+        }
+    }
+    if(m->num_people==0){
+        RefQueue* oppQ = (m->direction==UP)? &m->downQueue : &m->upQueue;
+        if(m->current_dir_boarded_count>=m->cfg->batch_size && oppQ->length>0){
+            m->direction = -m->direction;
+        } else {
+            m->direction = IDLE;
+        }
+        ref_trace(m, MALLSIM_EVENT_DIRECTION, 0, m->direction, m->current_dir_boarded_count);
+        m->current_dir_boarded_count=0;
+    }
+}
+
+static void ref_board_head(RefMall* m, RefQueue* q){
+    if(q->head && ref_can_board(m, q->head)){
+        ref_board(m, ref_dequeue(q));
+    }
+}
+
+static void ref_arrivals(RefMall* m){
+    int new_cust = rand() % (m->cfg->arrival_max + 1);
+    for(int i=0; i<new_cust; i++){
+        int dir = (rand() % 2 == 0) ? UP : DOWN;
+        m->out->arrivals++;
+        if(m->total_customers >= m->cfg->mall_capacity){
+            m->out->rejected++;
+            continue;
+        }
+        m->out->admitted++;
+        ref_create_customer(m, dir);
+    }
+}
+
+static int reference_supports(const MallConfig* cfg){
+    return !cfg->pair && cfg->lanes == 1 && cfg->classes == 1 && cfg->wait_bound == 0 &&
+           cfg->outage_length == 0 && cfg->breakdown_mtbf == 0 &&
+           cfg->balk_length == 0 && cfg->patience == 0 &&
+           cfg->overflow_policy == MALLSIM_OVERFLOW_REJECT && !cfg->arrival_stream;
+}
+
+int mallsim_reference_run(const MallConfig* cfg, MallResult* out){
+    if(mallsim_check_config(cfg) || !reference_supports(cfg)) return -1;
+    memset(out, 0, sizeof(*out));
+    RefMall m;
+    memset(&m, 0, sizeof(m));
+    m.cfg = cfg;
+    m.out = out;
+    m.direction = IDLE;
+
+    srand(cfg->seed);
+    for(int i=0; i<cfg->initial_customers; i++){
+        int dir = (rand() % 2 == 0) ? UP : DOWN;
+        ref_create_customer(&m, dir);
+    }
+
+    // One iteration of mall_control_loop per tick
+    while(1){
+        ref_operate(&m);
+        ref_board_head(&m, &m.upQueue);
+        ref_board_head(&m, &m.downQueue);
+        if(m.current_time < cfg->arrival_seconds){
+            ref_arrivals(&m);
+        }
+        out->ticks++;
+        if(m.out_of_memory || (m.current_time >= cfg->arrival_seconds && m.total_customers == 0)) break;
+        m.current_time++;
+    }
+    out->remaining = m.total_customers;
+    if(m.out_of_memory){
+        RefQueue* queues[2] = { &m.upQueue, &m.downQueue };
+        for(int q=0; q<2; q++){
+            while(queues[q]->head) free(ref_dequeue(queues[q]));
+        }
+        for(int i=0; i<MALLSIM_MAX_STEPS; i++) free(m.steps[i]);
+        return -1;
+    }
+    return 0;
+}
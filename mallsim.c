@@ -0,0 +1,2486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mallsim.h"
+
+#define UP    MALLSIM_UP
+#define DOWN  MALLSIM_DOWN
+#define IDLE  MALLSIM_IDLE
+
+// -------------------- Data Structures --------------------
+typedef struct Customer {
+    int id;
+    int arrival_time;  // Arrival time (seconds)
+    int queued_time;   // Time the customer joined its current queue
+    int direction;     // UP or DOWN
+    int position;      // 0 or 14 (kept as in original code)
+    int remaining_rides; // Escalators still to ride after the current one (building mode)
+    int board_time;    // First boarding, -1 before (per-customer records)
+    int total_wait;    // Seconds queued so far, over every escalator
+    int speed;         // Steps per tick on the escalator: 1 stands, more walks (two-lane model)
+    int priority;      // Priority class, 0 = none
+    struct Customer* next;
+    struct Customer* prev;
+
+    // Agent state (see customer_agent): resume point, patience and pending timer
+    int pc;
+    int patience;      // Seconds the customer queues before giving up, 0 = forever
+    int timer_at;      // Tick the pending timer fires, -1 if none
+    struct Customer* timer_next;
+    struct Customer* timer_prev;
+} Customer;
+
+/*
+ * A direction's line: one FIFO list per priority class. The head is the customer at the
+ * front, the next to board; it stays there until it boards. Who comes to the front next
+ * is decided by a deficit round robin over the classes with somebody waiting (see
+ * next_front), found with a bit scan, so it costs the same for any number of waiting people.
+ */
+typedef struct {
+    Customer* head;
+    int length;    // All classes
+    int direction; // 1=UP, -1=DOWN
+    int peak_length;
+    int head_since; // Tick the current head reached the front
+
+    Customer* class_head[MALLSIM_MAX_CLASSES];
+    Customer* class_tail[MALLSIM_MAX_CLASSES];
+    unsigned int waiting;   // Bit k set while class k has somebody queued
+    int turn;               // Class whose round it is
+    int credit;             // Fronts left in its round
+    int weight[MALLSIM_MAX_CLASSES];
+} Queue;
+
+/*
+ * One lane of the two-lane model (cfg.lanes == 2). Nobody passes anybody within a lane, so
+ * its riders step off in boarding order: a ring of riders, each with the tick it steps off,
+ * fixed when it boards. Stepping looks at the front of each lane and never at the others.
+ */
+#define LANE_STAND 0   // Right lane, riders move with the escalator
+#define LANE_WALK  1   // Left lane, riders walk at their own speed
+
+typedef struct {
+    struct Customer* riders[MALLSIM_MAX_STEPS];  // At most one rider per step
+    int exit_at[MALLSIM_MAX_STEPS];
+    int head;
+    int count;
+    int last_board;    // Tick of the latest boarding (one per tick)
+} Lane;
+
+/*
+ * The steps array has the physical maximum size; only the first cfg.escalator_steps
+ * elements are used (single-lane model; the two-lane model uses lanes instead).
+ * An instance is only ever touched by one thread at a time, so the capacity check in
+ * can_customer_board replaces the old capacity semaphore.
+ */
+typedef struct Escalator {
+    Customer* steps[MALLSIM_MAX_STEPS];
+    int direction; // UP / DOWN / IDLE
+    int num_people;
+    int fixed_direction; // UP / DOWN for a one-way unit of a pair, IDLE for the reversible escalator
+    int last_direction;  // Last direction it actually moved in, to count switches across idle periods
+
+    // Per-direction kernels and geometry, indexed by [direction == UP] (see advance_riders)
+    Customer* (*advance[2])(struct Escalator* e);
+    int entry[2];        // Step a boarding rider takes
+
+    Lane lanes[2];       // [LANE_STAND], [LANE_WALK]
+} Escalator;
+
+/*
+ * Per-instance random stream producing the same sequence as glibc's srand()/rand()
+ * (additive feedback generator, x[i] = x[i-3] + x[i-31]), so a seeded run gives the
+ * same customers as the programs did when they called rand() directly.
+ */
+typedef struct {
+    int32_t state[31];
+    int f;
+    int r;
+} Rng;
+
+// People waiting outside the mall for one direction (bounded ring of arrival times)
+typedef struct {
+    int* arrival_times;
+    int capacity;
+    int head;
+    int length;
+} HoldingBuffer;
+
+#define COUNTER_ADD(field, n)  __atomic_store_n(&(field), (field) + (n), __ATOMIC_RELAXED)
+#define COUNTER_SET(field, v)  __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+
+/*
+ * The timer wheel gets one slot per tick of the longest timer (patience or stairs), so a
+ * slot only ever holds the timers due in one tick, however many agents wait: a tick costs
+ * the timers it fires. Beyond the cap, slots are shared and filtered by timer_at.
+ */
+#define AGENT_TIMER_MIN_SLOTS 256
+#define AGENT_TIMER_MAX_SLOTS (1 << 22)
+
+#define FLIGHT_LINE 128   // Dump buffer bytes per line
+
+/*
+ * One escalator together with the queues at its two landings, and everything else a run
+ * needs: nothing is shared with other instances except, in a building, the customer id
+ * counter (only used while the building is populated, before any worker starts).
+ */
+struct MallSim {
+    MallConfig cfg;
+    Queue* upQueue;
+    Queue* downQueue;
+    Escalator* escalator;       // Reversible escalator, or the up unit in pair mode
+    Escalator* down_escalator;  // Down-only unit in pair mode, NULL otherwise
+    int total_customers;
+    int current_time;
+    int ticks;                  // Ticks simulated so far
+    int finished;
+    int out_of_memory;          // A customer could not be created: the run stopped short
+
+    int current_dir_boarded_count;  // How many people have boarded in the current direction
+    long total_turnaround_time;
+    long total_wait_time;
+    int completed_customers;
+    int peak_customers;
+    unsigned long completion_checksum; // Order-sensitive hash of (id, turnaround) completions
+    // Riders handed to the neighbouring escalators this tick (several per tick with a pair or two lanes)
+    Customer* transfer_out[2 * (MALLSIM_MAX_STEPS + 1)];
+    int transfers;
+    int wait_hist[MALLSIM_HIST_BUCKETS];
+    int turnaround_hist[MALLSIM_HIST_BUCKETS];
+    MallCounters counters;
+
+    Rng arrival_rng;                // Initial population and timed arrivals
+    Rng agent_rng;                  // Customer behaviour and shedding, so arrivals do not depend on it
+    Rng speed_rng;                  // Who walks and how fast, so a two-lane run keeps the same behaviour
+    Rng outage_rng;                 // Random breakdowns
+    Rng class_rng;                  // Priority classes
+    long arrival_next;              // Next direction to read from cfg.arrival_stream
+    int own_customer_id;
+    int* customer_id;               // Last id handed out (own_customer_id, or the building's)
+
+    Customer** timers;              // Hashed timer wheel of agents, slot = tick & timer_mask
+    int timer_mask;
+    int balked;
+    int reneged;
+    int rerouted;
+    long agent_resumes;
+
+    // Admission stage for timed arrivals
+    HoldingBuffer hold_up;
+    HoldingBuffer hold_down;
+    int arrivals;
+    int admitted;
+    int deferred;
+    int rejected;
+    int shed;
+    long outside_wait;
+
+    // Flight recorder: ring of the last cfg.flight_ticks ticks, written at the end of each tick
+    MallFlightRecord* flight;
+    int flight_next;                // Slot the next record goes to
+    int flight_count;
+    int flight_dumped[2];           // Last up / down head dumped, so a starving head is dumped once
+    int flight_dumps;
+    int worst_head_queue_wait;      // Since joining the queue, not since reaching the front
+    char* flight_text;              // Dump buffer, allocated with the ring
+
+    MallRecordBlock records;        // Rows not handed to cfg.records yet (one allocation for all columns)
+
+    // Wait bound (cfg.wait_bound)
+    int worst_front_wait;           // Longest time a boarding customer spent at the front of its queue
+    int bound_holds;                // Boardings held back so that the other head keeps its deadline
+    int bound_switches;             // Phases cut short by the bound
+    int bound_holding;              // The current phase has been cut short
+
+    int walkers;                    // Customers who took the walking lane
+
+    // Outages (see update_outage)
+    int halted_until;               // The escalator stands still while current_time < halted_until
+    int halted_ticks;               // Ticks stood still so far: the lanes' exit ticks are on the escalator's own clock
+    double queue_level;             // Moving average of both queues' length, outside episodes
+    int level_ticks;                // Ticks the average has taken in (it is warm at QUEUE_LEVEL_TICKS)
+    double episode_level;           // Level the current episode has to get back to, -1 = no episode
+    int episode_early;              // The current episode began before the average was warm
+    int outages;
+    int outage_episodes;
+    int outage_recoveries;
+    int outage_unmeasured;
+    long outage_recovery_total;
+    int outage_recovery_worst;
+    int outage_peak_queue;
+    int outage_peak_wait;
+    long outage_wait;
+    int outage_boardings;
+
+    // Per priority class
+    int class_customers[MALLSIM_MAX_CLASSES];
+    int class_boarded[MALLSIM_MAX_CLASSES];
+    long class_wait[MALLSIM_MAX_CLASSES];
+    int class_wait_max[MALLSIM_MAX_CLASSES];
+    int* class_wait_hist;           // [class * MALLSIM_HIST_BUCKETS + wait], with cfg.classes > 1 only
+
+    // Time series: the window being rolled up (the means are sums until it is handed over)
+    MallWindow window;
+    long window_steps;              // Steps that existed over its ticks
+};
+
+typedef struct MallSim Mall;
+
+struct MallBuilding {
+    MallConfig cfg;
+    int num_escalators;
+    Mall** malls;
+    int num_threads;
+    pthread_barrier_t barrier;
+    pthread_mutex_t start;   // Held while the workers are created; they give up if 'aborted'
+    int aborted;
+    int* remaining;   // Per-worker customer count, published at the end of every tick
+    int ticks;        // Number of ticks the last run took
+    int last_customer_id;
+};
+
+typedef struct {
+    MallBuilding* b;
+    int index;
+    int first;  // Escalators [first, last) are owned by this worker
+    int last;
+} BuildingWorker;
+
+// -------------------- Logging --------------------
+// Log lines go to the configured callback only; the engine itself never prints
+static void mall_log(Mall* m, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void mall_log(Mall* m, const char* fmt, ...){
+    char line[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    m->cfg.log(m->cfg.log_user, line);
+}
+
+#define LOG(m, ...) do { if((m)->cfg.log) mall_log((m), __VA_ARGS__); } while(0)
+
+// -------------------- Event Trace --------------------
+static void trace_event(Mall* m, int kind, int customer, int direction, int value){
+    MallEvent ev = { m->current_time, kind, customer, direction, value };
+    m->cfg.trace(m->cfg.trace_user, &ev);
+}
+
+#define TRACE(m, ...) do { if((m)->cfg.trace) trace_event((m), __VA_ARGS__); } while(0)
+
+// -------------------- Random Streams --------------------
+static int rng_next(Rng* g){
+    uint32_t val = (uint32_t)g->state[g->f] + (uint32_t)g->state[g->r];
+    g->state[g->f] = (int32_t)val;
+    if(++g->f >= 31){
+        g->f = 0;
+        g->r++;
+    } else if(++g->r >= 31){
+        g->r = 0;
+    }
+    return (int)(val >> 1);
+}
+
+// The state before the first 310 draws are discarded
+static void rng_fill(int32_t state[31], unsigned int seed){
+    int32_t word = (seed == 0) ? 1 : (int32_t)seed;
+    state[0] = word;
+    for(int i=1; i<31; i++){
+        // state[i] = 16807 * state[i-1] % 2147483647 without overflowing 31 bits
+        long hi = word / 127773;
+        long lo = word % 127773;
+        word = (int32_t)(16807 * lo - 2836 * hi);
+        if(word < 0) word += 2147483647;
+        state[i] = word;
+    }
+}
+
+static void rng_seed(Rng* g, unsigned int seed){
+    rng_fill(g->state, seed);
+    g->f = 3;
+    g->r = 0;
+    for(int i=0; i<310; i++){
+        rng_next(g);
+    }
+}
+
+// Arrivals shared between malls: what arrival_rng would draw for them, drawn once
+struct MallArrivals {
+    int initial_customers;
+    int seconds;
+    int* per_second;                // Timed arrivals in each second before 'seconds'
+    signed char* direction;         // The initial customers', then the timed arrivals' in order
+};
+
+static int draw_direction(Rng* g){
+    return (rng_next(g) % 2 == 0) ? UP : DOWN;
+}
+
+// The behaviour stream is seeded apart from the arrival stream
+static unsigned int agent_seed(unsigned int seed, int index){
+    return (seed ^ 0x2545f491u) + 0x9e3779b9u * (unsigned int)index;
+}
+
+// Further streams are seeded apart from both
+#define SPEED_STREAM  0x6a09e667u   // Who walks and how fast
+#define OUTAGE_STREAM 0xbb67ae85u   // Random breakdowns
+#define CLASS_STREAM  0x3c6ef372u   // Priority classes
+
+static unsigned int stream_seed(unsigned int seed, unsigned int stream, int index){
+    return agent_seed(seed ^ stream, index);
+}
+
+// --------------------------------------------------
+// Initialization
+// --------------------------------------------------
+static Queue* init_queue(int dir, const MallConfig* cfg) {
+    Queue* q = (Queue*)calloc(1, sizeof(Queue));
+    if(!q) return NULL;
+    q->head = NULL;
+    q->length = 0;
+    q->direction = dir;
+    q->peak_length = 0;
+    for(int k=0; k<cfg->classes; k++){
+        q->weight[k] = cfg->class_weight[k];
+    }
+    return q;
+}
+
+// --------------------------------------------------
+// Stepping kernels
+// --------------------------------------------------
+/*
+ * One tick of movement: the rider on the exit step (if any) is returned and everybody else
+ * moves one step towards it. A single implementation serves both directions, 'up' only
+ * decides which end is the exit. It is instantiated for every direction and length, so
+ * each instance is one fixed-size move with no per-step branches.
+ */
+static inline __attribute__((always_inline)) Customer* advance_riders(Escalator* e, int up, int steps){
+    Customer** s = e->steps;
+    Customer* leaving = s[up ? steps - 1 : 0];
+    memmove(s + up, s + !up, (size_t)(steps - 1) * sizeof(Customer*));
+    s[up ? 0 : steps - 1] = NULL;
+    return leaving;
+}
+
+#define ADVANCE_KERNELS(n) \
+    static Customer* advance_down_##n(Escalator* e) { return advance_riders(e, 0, n); } \
+    static Customer* advance_up_##n(Escalator* e)   { return advance_riders(e, 1, n); }
+ADVANCE_KERNELS(1)  ADVANCE_KERNELS(2)  ADVANCE_KERNELS(3)  ADVANCE_KERNELS(4)  ADVANCE_KERNELS(5)
+ADVANCE_KERNELS(6)  ADVANCE_KERNELS(7)  ADVANCE_KERNELS(8)  ADVANCE_KERNELS(9)  ADVANCE_KERNELS(10)
+ADVANCE_KERNELS(11) ADVANCE_KERNELS(12) ADVANCE_KERNELS(13)
+
+// [steps][direction == UP]
+static Customer* (*const advance_kernels[MALLSIM_MAX_STEPS + 1][2])(Escalator* e) = {
+    { NULL, NULL },
+    { advance_down_1,  advance_up_1  }, { advance_down_2,  advance_up_2  }, { advance_down_3,  advance_up_3  },
+    { advance_down_4,  advance_up_4  }, { advance_down_5,  advance_up_5  }, { advance_down_6,  advance_up_6  },
+    { advance_down_7,  advance_up_7  }, { advance_down_8,  advance_up_8  }, { advance_down_9,  advance_up_9  },
+    { advance_down_10, advance_up_10 }, { advance_down_11, advance_up_11 }, { advance_down_12, advance_up_12 },
+    { advance_down_13, advance_up_13 }
+};
+
+// --------------------------------------------------
+// Two-lane model
+// --------------------------------------------------
+static int lane_of(Customer* c){
+    return (c->speed > 1) ? LANE_WALK : LANE_STAND;
+}
+
+// A free entry step: fewer riders than steps, and nobody boarded this lane this tick
+static int lane_has_room(Mall* m, Lane* l){
+    return l->count < m->cfg.escalator_steps && l->last_board < m->current_time;
+}
+
+// Ticks the escalator has been running: outages stop the lanes without touching their riders
+static int escalator_clock(Mall* m){
+    return m->current_time - m->halted_ticks;
+}
+
+/*
+ * A stander steps off 'steps' ticks after boarding, like in single file. A walker needs
+ * ceil(steps / speed) ticks, but cannot pass the walker ahead of it: caught up, it steps
+ * off in the same tick as that one.
+ */
+static void lane_board(Mall* m, Lane* l, Customer* c){
+    int steps = m->cfg.escalator_steps;
+    int exit_at = escalator_clock(m) + (steps + c->speed - 1) / c->speed;
+    if(l->count > 0){
+        int ahead = l->exit_at[(l->head + l->count - 1) % MALLSIM_MAX_STEPS];
+        if(ahead > exit_at) exit_at = ahead;
+    }
+    int slot = (l->head + l->count) % MALLSIM_MAX_STEPS;
+    l->riders[slot] = c;
+    l->exit_at[slot] = exit_at;
+    l->count++;
+    l->last_board = m->current_time;
+}
+
+// The front rider if its exit tick has come, NULL otherwise
+static Customer* lane_leaving(Lane* l, int now){
+    if(l->count == 0 || l->exit_at[l->head] > now) return NULL;
+    Customer* c = l->riders[l->head];
+    l->riders[l->head] = NULL;
+    if(++l->head == MALLSIM_MAX_STEPS) l->head = 0;
+    l->count--;
+    return c;
+}
+
+static Escalator* init_escalator(int fixed_direction, int steps){
+    Escalator* e = (Escalator*)malloc(sizeof(Escalator));
+    if(!e) return NULL;
+    for(int i=0; i<MALLSIM_MAX_STEPS; i++){
+        e->steps[i] = NULL;
+        e->lanes[0].riders[i] = NULL;
+        e->lanes[1].riders[i] = NULL;
+    }
+    e->direction = fixed_direction;
+    e->num_people= 0;
+    e->fixed_direction = fixed_direction;
+    e->last_direction = IDLE;
+    e->advance[1] = advance_kernels[steps][1];
+    e->advance[0] = advance_kernels[steps][0];
+    e->entry[1] = 0;
+    e->entry[0] = steps - 1;
+    for(int l=0; l<2; l++){
+        e->lanes[l].head = 0;
+        e->lanes[l].count = 0;
+        e->lanes[l].last_board = -1;
+    }
+    return e;
+}
+
+// -1 if out of memory
+static int init_holding_buffer(HoldingBuffer* b, int capacity){
+    b->arrival_times = (int*)malloc(sizeof(int) * (capacity > 0 ? capacity : 1));
+    if(!b->arrival_times) return -1;
+    b->capacity = capacity;
+    b->head = 0;
+    b->length = 0;
+    return 0;
+}
+
+static void free_mall(Mall* m);
+
+// NULL if out of memory
+static Mall* init_mall(const MallConfig* cfg){
+    Mall* m = (Mall*)calloc(1, sizeof(Mall));
+    if(!m) return NULL;
+    m->cfg = *cfg;
+    m->upQueue   = init_queue(UP, cfg);
+    m->downQueue = init_queue(DOWN, cfg);
+    if(cfg->pair){
+        // Two one-way units of the same length sharing the arrivals
+        m->escalator = init_escalator(UP, cfg->escalator_steps);
+        m->down_escalator = init_escalator(DOWN, cfg->escalator_steps);
+    } else {
+        m->escalator = init_escalator(IDLE, cfg->escalator_steps);
+        m->down_escalator = NULL;
+    }
+    m->customer_id = &m->own_customer_id;
+
+    // Longest timer: the most patient customer (patience/2 + patience), or the stairs
+    long horizon = (long)cfg->patience / 2 + cfg->patience;
+    if(cfg->stairs_time > horizon) horizon = cfg->stairs_time;
+    int slots = AGENT_TIMER_MIN_SLOTS;
+    while(slots <= horizon && slots < AGENT_TIMER_MAX_SLOTS) slots *= 2;
+    m->timers = (Customer**)calloc(slots, sizeof(Customer*));
+    m->timer_mask = slots - 1;
+
+    if(cfg->classes > 1){
+        m->class_wait_hist = (int*)calloc((size_t)cfg->classes * MALLSIM_HIST_BUCKETS, sizeof(int));
+    }
+    rng_seed(&m->arrival_rng, cfg->seed);
+    rng_seed(&m->agent_rng, agent_seed(cfg->seed, 0));
+    rng_seed(&m->speed_rng, stream_seed(cfg->seed, SPEED_STREAM, 0));
+    rng_seed(&m->outage_rng, stream_seed(cfg->seed, OUTAGE_STREAM, 0));
+    rng_seed(&m->class_rng, stream_seed(cfg->seed, CLASS_STREAM, 0));
+    m->episode_level = -1.0;
+    int held = init_holding_buffer(&m->hold_up, cfg->holding_buffer) |
+               init_holding_buffer(&m->hold_down, cfg->holding_buffer);
+    if(cfg->flight_ticks > 0){
+        m->flight = (MallFlightRecord*)malloc(sizeof(MallFlightRecord) * cfg->flight_ticks);
+        m->flight_text = (char*)malloc(FLIGHT_LINE * (cfg->flight_ticks + 3));
+    }
+    int* rows = NULL;
+    if(cfg->records){
+        rows = (int*)malloc(sizeof(int) * MALLSIM_RECORD_COLUMNS * cfg->record_block);
+        if(rows){
+            for(int col=0; col<MALLSIM_RECORD_COLUMNS; col++){
+                m->records.column[col] = rows + (size_t)col * cfg->record_block;
+            }
+        }
+    }
+    if(!m->upQueue || !m->downQueue || !m->escalator || (cfg->pair && !m->down_escalator) ||
+       !m->timers || (cfg->classes > 1 && !m->class_wait_hist) || held ||
+       (cfg->flight_ticks > 0 && (!m->flight || !m->flight_text)) || (cfg->records && !rows)){
+        free_mall(m);
+        return NULL;
+    }
+    return m;
+}
+
+// The unit a customer travelling in 'direction' uses
+static Escalator* escalator_for(Mall* m, int direction){
+    if(direction == DOWN && m->down_escalator) return m->down_escalator;
+    return m->escalator;
+}
+
+// Create Customer Structure (just the data; its agent is started separately).
+// NULL if out of memory, which stops the mall (see mallsim_step)
+static Customer* create_customer_struct(Mall* m, int direction, int arrival_time) {
+    Customer* c = (Customer*)malloc(sizeof(Customer));
+    if(!c){
+        m->out_of_memory = 1;
+        return NULL;
+    }
+    c->id = ++*m->customer_id;
+    c->arrival_time = arrival_time;
+    c->queued_time  = arrival_time;
+    c->direction    = direction;
+    // Original code uses 0 or 14 for position, not changed.
+    c->position     = (direction==UP) ? 0 : 14;
+    c->remaining_rides = 0;
+    c->board_time   = -1;
+    c->total_wait   = 0;
+    c->speed        = 1;
+    if(m->cfg.lanes == 2 && rng_next(&m->speed_rng) % 100 < m->cfg.walker_percent){
+        c->speed = 2 + rng_next(&m->speed_rng) % (m->cfg.walk_speed_max - 1);
+        m->walkers++;
+    }
+    c->priority     = 0;
+    if(m->cfg.classes > 1){
+        int draw = rng_next(&m->class_rng) % 100;
+        for(int k=1, below=0; k<m->cfg.classes; k++){
+            below += m->cfg.class_percent[k];
+            if(draw < below){
+                c->priority = k;
+                break;
+            }
+        }
+    }
+    m->class_customers[c->priority]++;
+    c->next = NULL;
+    c->prev = NULL;
+    c->pc = 0;
+    c->patience = 0;
+    c->timer_at = -1;
+    c->timer_next = NULL;
+    c->timer_prev = NULL;
+    return c;
+}
+
+// --------------------------------------------------
+// Queue Operations
+// --------------------------------------------------
+/*
+ * Deficit round robin: the class whose round it is keeps the front for up to its weight
+ * of customers while it has any waiting; then the next waiting class in order gets its round.
+ */
+static Customer* next_front(Queue* q){
+    if(!q->waiting) return NULL;
+    if(q->credit == 0 || !(q->waiting & (1u << q->turn))){
+        unsigned int later = q->waiting & ~((2u << q->turn) - 1);
+        q->turn = __builtin_ctz(later ? later : q->waiting);
+        q->credit = q->weight[q->turn];
+    }
+    q->credit--;
+    return q->class_head[q->turn];
+}
+
+// Unlink c from its class list (the lists are doubly linked, so O(1))
+static void class_unlink(Queue* q, Customer* c){
+    int k = c->priority;
+    if(c->prev) c->prev->next = c->next; else q->class_head[k] = c->next;
+    if(c->next) c->next->prev = c->prev; else q->class_tail[k] = c->prev;
+    if(!q->class_head[k]) q->waiting &= ~(1u << k);
+    c->next = NULL;
+    c->prev = NULL;
+}
+
+static void enqueue(Mall* m, Queue* q, Customer* c){
+    int k = c->priority;
+    c->next = NULL;
+    c->prev = q->class_tail[k];
+    if(q->class_tail[k]) q->class_tail[k]->next = c;
+    else q->class_head[k] = c;
+    q->class_tail[k] = c;
+    q->waiting |= 1u << k;
+    if(q->length++ == 0){
+        q->head_since = m->current_time;
+        q->head = next_front(q);
+    }
+    if(q->length > q->peak_length) q->peak_length = q->length;
+    LOG(m, "Customer %d joined the queue, direction: %s, arrival time: %d\n",
+        c->id,
+        (q->direction==UP)?"Up":"Down",
+        c->queued_time);
+    TRACE(m, MALLSIM_EVENT_ENTER, c->id, c->direction, c->arrival_time);
+}
+
+static Customer* dequeue(Queue* q){
+    if(!q->head){
+        return NULL;
+    }
+    Customer* c = q->head;
+    class_unlink(q, c);
+    q->length--;
+    q->head = next_front(q);
+    return c;
+}
+
+// Unlink a customer from anywhere in the queue
+static void queue_remove(Queue* q, Customer* c){
+    class_unlink(q, c);
+    q->length--;
+    if(c == q->head) q->head = next_front(q);
+}
+
+// --------------------------------------------------
+// Per-Customer Records
+// --------------------------------------------------
+static void flush_records(Mall* m){
+    if(m->records.rows == 0) return;
+    m->cfg.records(m->cfg.records_user, &m->records);
+    m->records.rows = 0;
+}
+
+// One row per customer, written once it is done; full blocks go to cfg.records
+static void record_customer(Mall* m, Customer* c, int outcome){
+    if(!m->cfg.records) return;
+    int row = m->records.rows++;
+    m->records.column[MALLSIM_COL_ID][row]        = c->id;
+    m->records.column[MALLSIM_COL_DIRECTION][row] = c->direction;
+    m->records.column[MALLSIM_COL_ARRIVAL][row]   = c->arrival_time;
+    m->records.column[MALLSIM_COL_BOARD][row]     = c->board_time;
+    m->records.column[MALLSIM_COL_WAIT][row]      = c->total_wait;
+    m->records.column[MALLSIM_COL_FINISH][row]    = m->current_time;
+    m->records.column[MALLSIM_COL_OUTCOME][row]   = outcome;
+    m->records.column[MALLSIM_COL_CLASS][row]     = c->priority;
+    if(m->records.rows == m->cfg.record_block) flush_records(m);
+}
+
+// --------------------------------------------------
+// Customer Agents
+// --------------------------------------------------
+/*
+ * Each customer is a stackless coroutine: customer_agent() keeps its resume point in
+ * Customer.pc and everything it needs across suspensions in the Customer itself, so a
+ * suspended agent costs sizeof(Customer) and no kernel thread. The control loop resumes
+ * it on events; the agent returns AGENT_GONE once it has left the mall (the caller frees it).
+ * An agent must not touch any other agent; it may only move itself.
+ */
+#define EV_ARRIVED      0
+#define EV_AT_HEAD      1   // Became the first in its queue
+#define EV_TIMEOUT      2   // Its timer fired
+#define EV_BOARDED      3
+#define EV_DISEMBARKED  4   // Stepped off at its destination
+
+#define AGENT_ALIVE 1
+#define AGENT_GONE  0
+
+#define AGENT_BEGIN(c)  switch((c)->pc){ case 0:
+#define AGENT_WAIT(c)   do { (c)->pc = __LINE__; return AGENT_ALIVE; case __LINE__:; } while(0)
+#define AGENT_EXIT(c)   do { (c)->pc = -1; return AGENT_GONE; } while(0)
+#define AGENT_END(c)    } (c)->pc = -1; return AGENT_GONE
+
+static Queue* queue_of(Mall* m, Customer* c){
+    return (c->direction == UP) ? m->upQueue : m->downQueue;
+}
+
+static void arm_timer(Mall* m, Customer* c, int at){
+    Customer** slot = &m->timers[at & m->timer_mask];
+    c->timer_at = at;
+    c->timer_prev = NULL;
+    c->timer_next = *slot;
+    if(*slot) (*slot)->timer_prev = c;
+    *slot = c;
+}
+
+static void disarm_timer(Mall* m, Customer* c){
+    if(c->timer_at < 0) return;
+    if(c->timer_prev) c->timer_prev->timer_next = c->timer_next;
+    else m->timers[c->timer_at & m->timer_mask] = c->timer_next;
+    if(c->timer_next) c->timer_next->timer_prev = c->timer_prev;
+    c->timer_at = -1;
+    c->timer_next = NULL;
+    c->timer_prev = NULL;
+}
+
+static void record_completion(Mall* m, Customer* c, const char* how, int outcome){
+    int tat = m->current_time - c->arrival_time;
+    LOG(m, "Customer %d completed %s travel, Turnaround time = %d sec\n", c->id, how, tat);
+    TRACE(m, MALLSIM_EVENT_FINISH, c->id, c->direction, tat);
+    m->total_turnaround_time += tat;
+    m->completed_customers++;
+    m->turnaround_hist[(tat < MALLSIM_HIST_BUCKETS) ? tat : MALLSIM_HIST_BUCKETS-1]++;
+    COUNTER_ADD(m->counters.completed, 1);
+    m->completion_checksum = m->completion_checksum * 1000003UL + (unsigned long)c->id * 131UL + (unsigned long)tat;
+    if(c->direction == UP) m->window.completed_up++;
+    else m->window.completed_down++;
+    record_customer(m, c, outcome);
+}
+
+static int customer_agent(Mall* m, Customer* c, int event){
+    AGENT_BEGIN(c);
+
+    // Balking: one look at the queue is enough to turn around
+    if(m->cfg.balk_length > 0 && queue_of(m, c)->length >= m->cfg.balk_length){
+        m->balked++;
+        LOG(m, "Customer %d balks at a queue of %d\n", c->id, queue_of(m, c)->length);
+        record_customer(m, c, MALLSIM_OUTCOME_BALKED);
+        AGENT_EXIT(c);
+    }
+    enqueue(m, queue_of(m, c), c);
+    m->total_customers++;
+    if(c->patience > 0 && queue_of(m, c)->head != c){
+        arm_timer(m, c, m->current_time + c->patience);
+    }
+
+    // Waiting in line: once at the head the customer stays; running out of patience before that means leaving
+    while(1){
+        AGENT_WAIT(c);
+        if(event == EV_AT_HEAD || event == EV_BOARDED){
+            disarm_timer(m, c);
+            break;
+        }
+        if(event == EV_TIMEOUT){
+            queue_remove(queue_of(m, c), c);
+            if(m->cfg.stairs_time > 0){
+                m->rerouted++;
+                LOG(m, "Customer %d gives up after %d sec and takes the stairs\n", c->id, c->patience);
+                arm_timer(m, c, m->current_time + m->cfg.stairs_time);
+                do { AGENT_WAIT(c); } while(event != EV_TIMEOUT);
+                record_completion(m, c, (c->direction==UP)? "upward (stairs)" : "downward (stairs)", MALLSIM_OUTCOME_STAIRS);
+            } else {
+                m->reneged++;
+                LOG(m, "Customer %d gives up after %d sec and leaves\n", c->id, c->patience);
+                record_customer(m, c, MALLSIM_OUTCOME_RENEGED);
+            }
+            m->total_customers--;
+            AGENT_EXIT(c);
+        }
+    }
+
+    // Riding (in a building: and queueing for the next escalators) until the last step-off
+    while(event != EV_DISEMBARKED){
+        AGENT_WAIT(c);
+    }
+    AGENT_END(c);
+}
+
+// Resume an agent with an event; frees it once it has left
+static void agent_resume(Mall* m, Customer* c, int event){
+    m->agent_resumes++;
+    if(customer_agent(m, c, event) == AGENT_GONE){
+        disarm_timer(m, c);
+        free(c);
+    }
+}
+
+// The new head of q (if any) learns it is next
+static void notify_queue_head(Mall* m, Queue* q){
+    if(q->head) agent_resume(m, q->head, EV_AT_HEAD);
+}
+
+// Hand a freshly created customer to its agent: it queues up or balks
+static void start_customer_agent(Mall* m, Customer* c){
+    if(m->cfg.patience > 0){
+        c->patience = m->cfg.patience / 2 + rng_next(&m->agent_rng) % (m->cfg.patience + 1);
+    }
+    agent_resume(m, c, EV_ARRIVED);
+}
+
+// Fire the timers due this tick
+static void wake_agents(Mall* m){
+    Customer* c = m->timers[m->current_time & m->timer_mask];
+    while(c){
+        Customer* next = c->timer_next;
+        if(c->timer_at == m->current_time){
+            disarm_timer(m, c);
+            agent_resume(m, c, EV_TIMEOUT);
+        }
+        c = next;
+    }
+}
+
+// A new agent arriving at arrival_time enters the mall
+static void create_customer(Mall* m, int direction, int arrival_time){
+    Customer* c = create_customer_struct(m, direction, arrival_time);
+    if(!c) return;
+    LOG(m, "Customer agent created, direction: %s\n", (direction==UP)?"Up":"Down");
+    start_customer_agent(m, c);
+}
+
+// --------------------------------------------------
+// Admission Control (timed arrivals)
+// --------------------------------------------------
+
+// Bounded: never grows past its capacity, whatever the overload
+static int holding_push(HoldingBuffer* b, int arrival_time){
+    if(b->length >= b->capacity) return 0;
+    b->arrival_times[(b->head + b->length) % b->capacity] = arrival_time;
+    b->length++;
+    return 1;
+}
+
+static int holding_pop(HoldingBuffer* b){
+    int t = b->arrival_times[b->head];
+    b->head = (b->head + 1) % b->capacity;
+    b->length--;
+    return t;
+}
+
+// An arrival enters directly only if there is room and nobody of its direction is waiting outside
+static void admit_arrival(Mall* m, int direction, int arrival_time){
+    HoldingBuffer* b = (direction==UP)? &m->hold_up : &m->hold_down;
+    const char* dir_name = (direction==UP)?"Up":"Down";
+    m->arrivals++;
+    m->window.arrivals++;
+
+    if(m->total_customers < m->cfg.mall_capacity && b->length == 0){
+        m->admitted++;
+        create_customer(m, direction, arrival_time);
+        return;
+    }
+
+    if(m->cfg.overflow_policy == MALLSIM_OVERFLOW_REJECT){
+        m->rejected++;
+        LOG(m, "Mall is full, customer (%s) turned away\n", dir_name);
+    } else if(m->cfg.overflow_policy == MALLSIM_OVERFLOW_SHED && b->capacity > 0 &&
+              rng_next(&m->agent_rng) % b->capacity < b->length){
+        // The fuller the buffer, the likelier an arrival gives up straight away
+        m->shed++;
+        LOG(m, "Mall is full, customer (%s) shed (%d/%d waiting outside)\n", dir_name, b->length, b->capacity);
+    } else if(holding_push(b, arrival_time)){
+        m->deferred++;
+        LOG(m, "Mall is full, customer (%s) waits outside (%d/%d)\n", dir_name, b->length, b->capacity);
+    } else {
+        m->rejected++;
+        LOG(m, "Mall is full and the %s holding buffer is full, customer turned away\n", dir_name);
+    }
+}
+
+// Let people waiting outside in, oldest first across both directions, while there is room
+static void release_waiting_customers(Mall* m){
+    while(m->total_customers < m->cfg.mall_capacity && (m->hold_up.length > 0 || m->hold_down.length > 0)){
+        HoldingBuffer* b;
+        if(m->hold_down.length == 0){
+            b = &m->hold_up;
+        } else if(m->hold_up.length == 0){
+            b = &m->hold_down;
+        } else {
+            b = (m->hold_up.arrival_times[m->hold_up.head] <= m->hold_down.arrival_times[m->hold_down.head])
+                ? &m->hold_up : &m->hold_down;
+        }
+        int direction = (b == &m->hold_up) ? UP : DOWN;
+        int arrival_time = holding_pop(b);
+        m->admitted++;
+        m->outside_wait += m->current_time - arrival_time;
+        LOG(m, "Customer waiting outside since %d sec enters the mall, direction: %s\n",
+            arrival_time, (direction==UP)?"Up":"Down");
+        create_customer(m, direction, arrival_time);
+    }
+}
+
+// From the shared arrival stream if there is one
+static int next_direction(Mall* m){
+    if(m->cfg.arrival_stream) return m->cfg.arrival_stream->direction[m->arrival_next++];
+    return draw_direction(&m->arrival_rng);
+}
+
+// Step 5 of the loop: people outside first, then this second's 0-2 (0..arrival_max) new arrivals
+static void generate_arrivals(Mall* m){
+    release_waiting_customers(m);
+    if(m->current_time < m->cfg.arrival_seconds){
+        int new_cust = m->cfg.arrival_stream ? m->cfg.arrival_stream->per_second[m->current_time]
+                                             : rng_next(&m->arrival_rng) % (m->cfg.arrival_max + 1); // 0~2 by default
+        if(new_cust > 0){
+            LOG(m, "%d new customers arrived this second\n", new_cust);
+            for(int i=0; i<new_cust; i++){
+                int dir = next_direction(m);
+                admit_arrival(m, dir, m->current_time);
+            }
+        } else {
+            LOG(m, "No new customers this second\n");
+        }
+    } else {
+        LOG(m, ">= %d seconds, no more new customers will be generated\n", m->cfg.arrival_seconds);
+    }
+}
+
+// --------------------------------------------------
+// Outages
+// --------------------------------------------------
+#define QUEUE_LEVEL_TICKS 60   // Span of the moving average the queues have to get back to
+#define RECOVERY_BAND 0.1      // The queues are back once within 10% (and one person) of it
+
+static int escalator_halted(Mall* m){
+    return m->current_time < m->halted_until;
+}
+
+// Stops the escalator for 'length' ticks from now (a stop during a stop extends it)
+static void stop_escalator(Mall* m, int length, const char* why){
+    if(!escalator_halted(m)){
+        m->outages++;
+        if(m->episode_level < 0){
+            m->outage_episodes++;
+            m->episode_level = m->queue_level;
+            m->episode_early = m->level_ticks < QUEUE_LEVEL_TICKS;
+        }
+    }
+    if(m->current_time + length > m->halted_until) m->halted_until = m->current_time + length;
+    LOG(m, "Escalator stopped (%s), running again at %d sec\n", why, m->halted_until);
+}
+
+/*
+ * Called at the start of every tick. A running escalator breaks down with probability
+ * 1 / breakdown_mtbf per tick; a repair takes 1..2*breakdown_mttr-1 ticks.
+ */
+static void update_outage(Mall* m){
+    if(m->cfg.outage_length > 0 && m->current_time == m->cfg.outage_start){
+        stop_escalator(m, m->cfg.outage_length, "scheduled maintenance");
+    }
+    if(m->cfg.breakdown_mtbf > 0 && !escalator_halted(m) &&
+       rng_next(&m->outage_rng) % m->cfg.breakdown_mtbf == 0){
+        stop_escalator(m, 1 + rng_next(&m->outage_rng) % (2 * m->cfg.breakdown_mttr - 1), "breakdown");
+    }
+    if(escalator_halted(m)){
+        m->halted_ticks++;
+        COUNTER_ADD(m->counters.outage_ticks, 1);
+    }
+}
+
+// Somebody in q has been queued since before the escalator last ran again
+static int queue_stranded(Mall* m, Queue* q){
+    for(unsigned int w = q->waiting; w; w &= w - 1){
+        if(q->class_head[__builtin_ctz(w)]->queued_time < m->halted_until) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Called once at the end of every tick. The level is the plain mean of the first
+ * QUEUE_LEVEL_TICKS ticks, a moving average after that. An episode ends once everybody
+ * queued through the stop has boarded (or left) and the queues are back within the band
+ * of their level; one that began before the level was warm has no level to measure
+ * recovery against, so it only counts as unmeasured.
+ */
+static void track_recovery(Mall* m){
+    int queued = m->upQueue->length + m->downQueue->length;
+    if(m->episode_level < 0){
+        if(m->level_ticks < QUEUE_LEVEL_TICKS) m->level_ticks++;
+        m->queue_level += (queued - m->queue_level) / m->level_ticks;
+        return;
+    }
+    if(queued > m->outage_peak_queue) m->outage_peak_queue = queued;
+    if(escalator_halted(m) || queue_stranded(m, m->upQueue) || queue_stranded(m, m->downQueue) ||
+       queued > m->episode_level * (1.0 + RECOVERY_BAND) + 1.0){
+        return;
+    }
+    int recovery = m->current_time + 1 - m->halted_until;
+    if(m->episode_early){
+        LOG(m, "Queues cleared %d sec after the restart (no level yet to compare with)\n", recovery);
+        m->outage_unmeasured++;
+    } else {
+        LOG(m, "Queues back to their level (%.1f) %d sec after the restart\n", m->episode_level, recovery);
+        m->outage_recoveries++;
+        m->outage_recovery_total += recovery;
+        if(recovery > m->outage_recovery_worst) m->outage_recovery_worst = recovery;
+    }
+    m->episode_level = -1.0;
+}
+
+// --------------------------------------------------
+// Check if a Customer Can Board the Escalator
+// --------------------------------------------------
+/*
+ * Wait bound: a head that reached the front at head_since must board by head_since +
+ * wait_bound. It is at risk once anybody else boarding now would push its turn past that,
+ * since the escalator only empties for it 'steps' ticks after the last boarding.
+ */
+static int head_at_risk(Mall* m, Queue* q){
+    return q->head && m->current_time + m->cfg.escalator_steps > q->head_since + m->cfg.wait_bound;
+}
+
+static int bound_pending(Mall* m){
+    return m->cfg.wait_bound > 0 && (head_at_risk(m, m->upQueue) || head_at_risk(m, m->downQueue));
+}
+
+// Idle escalator: the head of c's queue gives way to an opposite head with an earlier or equal deadline at risk
+static int bound_yields(Mall* m, Customer* c){
+    if(m->cfg.wait_bound <= 0) return 0;
+    Queue* ownQ = (c->direction==UP)? m->upQueue: m->downQueue;
+    Queue* oppQ = (c->direction==UP)? m->downQueue: m->upQueue;
+    return head_at_risk(m, oppQ) && (!head_at_risk(m, ownQ) || oppQ->head_since <= ownQ->head_since);
+}
+
+static int can_customer_board(Mall* m, Customer* c){
+    Escalator* e = escalator_for(m, c->direction);
+
+    // Nobody boards a stopped escalator
+    if(escalator_halted(m)){
+        return 0;
+    }
+
+    // If the escalator is full, they cannot board (two lanes: if their lane has no free entry step)
+    if(m->cfg.lanes == 2){
+        if(!lane_has_room(m, &e->lanes[lane_of(c)])) return 0;
+    } else if(e->num_people >= m->cfg.escalator_steps) {
+        return 0;
+    }
+
+    // A one-way unit never switches, so there is nobody to protect from starvation
+    if(e->fixed_direction != IDLE){
+        return 1;
+    }
+
+    // If the escalator is idle, customer can board and set direction
+    if(e->direction == IDLE){
+        if(bound_yields(m, c)){
+            m->bound_holds++;
+            return 0;
+        }
+        e->direction = c->direction;
+        if(e->last_direction != IDLE && e->last_direction != e->direction){
+            COUNTER_ADD(m->counters.direction_switches, 1);
+        }
+        e->last_direction = e->direction;
+        TRACE(m, MALLSIM_EVENT_DIRECTION, 0, e->direction, m->current_dir_boarded_count);
+        m->current_dir_boarded_count = 0;
+        return 1;
+    }
+
+    // If escalator direction matches the customer's direction, allow boarding
+    if(e->direction == c->direction){
+        // If we already boarded a batch (>=5 people) in this direction AND there are people waiting in the opposite queue => deny
+        Queue* oppQ = (c->direction==UP)? m->downQueue: m->upQueue;
+        if(oppQ->length>0 && m->current_dir_boarded_count>=m->cfg.batch_size){
+            return 0;
+        }
+        // Wait bound: stop boarding early enough for the opposite head to board in time
+        if(m->cfg.wait_bound > 0 && e->num_people > 0 && head_at_risk(m, oppQ)){
+            m->bound_holds++;
+            m->bound_holding = 1;
+            return 0;
+        }
+        return 1;
+    }
+
+    // Opposite direction => cannot board
+    return 0;
+}
+
+// --------------------------------------------------
+// Customer Boards the Escalator
+// --------------------------------------------------
+static void board_customer(Mall* m, Customer* c){
+    Escalator* e = escalator_for(m, c->direction);
+
+    if(m->cfg.lanes == 2){
+        lane_board(m, &e->lanes[lane_of(c)], c);
+    } else {
+        e->steps[e->entry[c->direction == UP]] = c;
+    }
+    e->num_people++;
+    m->current_dir_boarded_count++;
+    COUNTER_ADD(m->counters.boarded, 1);
+    int wait_time = m->current_time - c->queued_time;
+    m->total_wait_time += wait_time;
+    if(c->board_time < 0) c->board_time = m->current_time;
+    c->total_wait += wait_time;
+    m->wait_hist[(wait_time < MALLSIM_HIST_BUCKETS) ? wait_time : MALLSIM_HIST_BUCKETS-1]++;
+    m->class_boarded[c->priority]++;
+    m->class_wait[c->priority] += wait_time;
+    if(wait_time > m->class_wait_max[c->priority]) m->class_wait_max[c->priority] = wait_time;
+    if(m->class_wait_hist){
+        m->class_wait_hist[c->priority * MALLSIM_HIST_BUCKETS +
+                           ((wait_time < MALLSIM_HIST_BUCKETS) ? wait_time : MALLSIM_HIST_BUCKETS-1)]++;
+    }
+    if(c->queued_time < m->halted_until){
+        m->outage_wait += wait_time;
+        m->outage_boardings++;
+        if(wait_time > m->outage_peak_wait) m->outage_peak_wait = wait_time;
+    }
+    LOG(m, "Customer %d boarded the escalator, direction: %s, wait time=%d sec, transported=%d people\n",
+        c->id,
+        (c->direction==UP)?"Up":"Down",
+        wait_time, m->current_dir_boarded_count);
+    TRACE(m, MALLSIM_EVENT_BOARD, c->id, c->direction, wait_time);
+    agent_resume(m, c, EV_BOARDED);
+}
+
+static void board_front(Mall* m, Queue* q){
+    int front_wait = m->current_time - q->head_since;
+    if(front_wait > m->worst_front_wait) m->worst_front_wait = front_wait;
+    board_customer(m, dequeue(q));
+    q->head_since = m->current_time;
+    notify_queue_head(m, q);
+}
+
+// Attempt to board the first customer waiting in q (one boarding per queue per tick, per lane with two lanes)
+static void board_queue_head(Mall* m, Queue* q){
+    Customer* c = q->head;
+    if(c){
+        if(can_customer_board(m, c)){
+            board_front(m, q);
+            // The next in line may step onto the other lane in the same tick
+            if(m->cfg.lanes == 2 && q->head && lane_of(q->head) != lane_of(c) && can_customer_board(m, q->head)){
+                board_front(m, q);
+            }
+        } else {
+            LOG(m, "%s customer %d cannot board the escalator yet\n",
+                (q->direction==UP)?"Upward":"Downward", c->id);
+        }
+    }
+}
+
+// --------------------------------------------------
+// Move Customers on the Escalator Every Second
+// --------------------------------------------------
+
+// A rider stepped off the end: either the trip is over, or (building mode) the
+// rider is handed over to the next escalator in the same direction.
+static void disembark_customer(Mall* m, Customer* c){
+    m->total_customers--;
+    if(c->remaining_rides > 0){
+        c->remaining_rides--;
+        m->transfer_out[m->transfers++] = c;
+        LOG(m, "Customer %d transfers to the next escalator, direction: %s\n",
+            c->id, (c->direction==UP)?"Up":"Down");
+        return;
+    }
+    record_completion(m, c, (c->direction==UP)?"upward":"downward", MALLSIM_OUTCOME_RODE);
+    agent_resume(m, c, EV_DISEMBARKED);
+}
+
+static void operate_unit(Mall* m, Escalator* e){
+    if(e->num_people>0){
+        LOG(m, "Escalator direction = %s, Passengers = %d\n",
+            (e->direction==UP)?"Up":
+            (e->direction==DOWN)?"Down":"Idle",
+            e->num_people);
+
+        if(m->cfg.lanes == 2){
+            // Everybody whose exit tick has come gets off, standers first
+            for(int l=0; l<2; l++){
+                Customer* c;
+                while( (c = lane_leaving(&e->lanes[l], escalator_clock(m))) != NULL ){
+                    e->num_people--;
+                    disembark_customer(m, c);
+                }
+            }
+        } else {
+            // Everyone moves one step; whoever was on the exit step gets off
+            Customer* c = e->advance[e->direction == UP](e);
+            if(c){
+                e->num_people--;
+                disembark_customer(m, c);
+            }
+        }
+
+        // If escalator is now empty, decide whether to force a direction switch
+        // (one-way units of a pair keep their direction)
+        if(e->num_people==0 && e->fixed_direction==IDLE){
+            LOG(m, "Escalator is now empty. Passengers transported in this direction = %d\n", m->current_dir_boarded_count);
+
+            // If we have transported a batch (>=5 people) and there are people waiting in the opposite direction => switch direction
+            Queue* oppQ = (e->direction==UP)? m->downQueue: m->upQueue;
+            int oppLen  = oppQ->length;
+
+            if(m->bound_holding){
+                m->bound_switches++;
+                m->bound_holding = 0;
+            }
+            // With a head at risk the escalator goes idle, and the most urgent head takes it (bound_yields)
+            if(m->current_dir_boarded_count>=m->cfg.batch_size && oppLen>0 && !bound_pending(m)){
+                LOG(m, ">=%d people have crossed, and there are customers waiting in the opposite direction. Forcing direction switch to %s\n",
+                    m->cfg.batch_size, (e->direction==UP)?"Down":"Up");
+                e->direction = - e->direction;
+                e->last_direction = e->direction;
+                COUNTER_ADD(m->counters.direction_switches, 1);
+            } else {
+                e->direction = IDLE;
+            }
+            TRACE(m, MALLSIM_EVENT_DIRECTION, 0, e->direction, m->current_dir_boarded_count);
+            // Reset count
+            m->current_dir_boarded_count=0;
+        }
+    }
+}
+
+static void operate_escalator(Mall* m){
+    if(escalator_halted(m)){
+        LOG(m, "Escalator stopped, %d sec until it runs again\n", m->halted_until - m->current_time);
+        return;
+    }
+    operate_unit(m, m->escalator);
+    if(m->down_escalator){
+        operate_unit(m, m->down_escalator);
+    }
+}
+
+// --------------------------------------------------
+// Counters
+// --------------------------------------------------
+
+// Riders still aboard, opposite side waiting, and nobody else will board in this direction
+static int unit_is_draining(Mall* m, Escalator* e){
+    if(e->fixed_direction != IDLE || e->num_people == 0) return 0;
+    Queue* ownQ = (e->direction==UP)? m->upQueue : m->downQueue;
+    Queue* oppQ = (e->direction==UP)? m->downQueue : m->upQueue;
+    return oppQ->length > 0 && (ownQ->length == 0 || m->current_dir_boarded_count >= m->cfg.batch_size);
+}
+
+static void count_unit(Mall* m, Escalator* e){
+    MallCounters* k = &m->counters;
+    COUNTER_ADD(k->occupied_step_ticks, e->num_people);
+    COUNTER_ADD(k->step_ticks, m->cfg.escalator_steps * m->cfg.lanes);
+    COUNTER_ADD(k->unit_ticks, 1);
+    if(e->num_people == 0) COUNTER_ADD(k->idle_unit_ticks, 1);
+    if(unit_is_draining(m, e)) COUNTER_ADD(k->drain_ticks, 1);
+}
+
+// Called once at the end of every tick
+static void update_counters(Mall* m){
+    MallCounters* k = &m->counters;
+    int on = m->escalator->num_people;
+    count_unit(m, m->escalator);
+    if(m->down_escalator){
+        on += m->down_escalator->num_people;
+        count_unit(m, m->down_escalator);
+    }
+    COUNTER_ADD(k->ticks, 1);
+    if(on == 0) COUNTER_ADD(k->idle_ticks, 1);
+    COUNTER_SET(k->on_escalator, on);
+    COUNTER_SET(k->up_queue_length, m->upQueue->length);
+    COUNTER_SET(k->down_queue_length, m->downQueue->length);
+    COUNTER_SET(k->peak_up_queue, m->upQueue->peak_length);
+    COUNTER_SET(k->peak_down_queue, m->downQueue->peak_length);
+    if(m->total_customers > m->peak_customers) m->peak_customers = m->total_customers;
+}
+
+// --------------------------------------------------
+// Time Series
+// --------------------------------------------------
+static void emit_window(Mall* m){
+    MallWindow* w = &m->window;
+    if(w->ticks == 0) return;
+    w->mean_up_queue /= w->ticks;
+    w->mean_down_queue /= w->ticks;
+    w->occupancy = m->window_steps ? w->occupancy / m->window_steps : 0.0;
+    m->cfg.windows(m->cfg.windows_user, w);
+    memset(w, 0, sizeof(*w));
+    m->window_steps = 0;
+}
+
+// Called once at the end of every tick, after update_counters
+static void roll_window(Mall* m){
+    MallWindow* w = &m->window;
+    int up = m->upQueue->length, down = m->downQueue->length;
+    if(w->ticks++ == 0) w->start = m->current_time;
+    w->mean_up_queue += up;
+    w->mean_down_queue += down;
+    if(up > w->max_up_queue) w->max_up_queue = up;
+    if(down > w->max_down_queue) w->max_down_queue = down;
+    w->occupancy += m->counters.on_escalator;
+    m->window_steps += m->cfg.escalator_steps * m->cfg.lanes * (m->down_escalator ? 2 : 1);
+    if(w->ticks == m->cfg.window) emit_window(m);
+}
+
+// --------------------------------------------------
+// Escalator status (log only)
+// --------------------------------------------------
+static void log_unit_status(Mall* m, Escalator* e){
+    char line[512];
+    int n = snprintf(line, sizeof(line), "Escalator status: [");
+    for(int i=0; i<m->cfg.escalator_steps; i++){
+        n += snprintf(line + n, sizeof(line) - n, "%d%s",
+                      e->steps[i] ? e->steps[i]->id : 0,
+                      (i < m->cfg.escalator_steps-1) ? "," : "");
+    }
+    LOG(m, "%s], Direction: %s\n", line,
+        (e->direction==UP)?"Up":
+        (e->direction==DOWN)?"Down":"Idle");
+}
+
+// Two lanes: riders in boarding order with the tick each steps off
+static void log_lane_status(Mall* m, Escalator* e){
+    char line[1024];
+    int n = 0;
+    for(int l=0; l<2; l++){
+        const Lane* lane = &e->lanes[l];
+        n += snprintf(line + n, sizeof(line) - n, "%s%s [", l ? "], " : "", l ? "walk" : "stand");
+        for(int i=0; i<lane->count; i++){
+            int slot = (lane->head + i) % MALLSIM_MAX_STEPS;
+            n += snprintf(line + n, sizeof(line) - n, "%s%d@%d", i ? "," : "",
+                          lane->riders[slot]->id, lane->exit_at[slot]);
+        }
+    }
+    LOG(m, "Escalator lanes: %s], Direction: %s\n", line,
+        (e->direction==UP)?"Up":
+        (e->direction==DOWN)?"Down":"Idle");
+}
+
+static void log_escalator_status(Mall* m){
+    if(!m->cfg.log) return;
+    void (*log_unit)(Mall*, Escalator*) = (m->cfg.lanes == 2) ? log_lane_status : log_unit_status;
+    log_unit(m, m->escalator);
+    if(m->down_escalator){
+        log_unit(m, m->down_escalator);
+    }
+}
+
+// --------------------------------------------------
+// Flight recorder
+// --------------------------------------------------
+
+// Writes the ring, oldest tick first, into flight_text and hands it to the dump callback
+static void flight_dump(Mall* m, Customer* head, int wait){
+    char* text = m->flight_text;
+    size_t size = FLIGHT_LINE * (m->cfg.flight_ticks + 3);
+    int n = snprintf(text, size,
+                     "===== Flight recorder: %s customer %d has waited %d sec at the head of the queue (time %d) =====\n",
+                     (head->direction==UP)?"Up":"Down", head->id, wait, m->current_time);
+    n += snprintf(text + n, size - n, "%7s %5s %5s %8s %6s %8s %6s %5s %7s %6s\n",
+                  "time", "upQ", "downQ", "up head", "wait", "dn head", "wait", "dir", "riders", "batch");
+    int first = (m->flight_next - m->flight_count + m->cfg.flight_ticks) % m->cfg.flight_ticks;
+    for(int i=0; i<m->flight_count && (size_t)n < size; i++){
+        const MallFlightRecord* r = &m->flight[(first + i) % m->cfg.flight_ticks];
+        n += snprintf(text + n, size - n, "%7d %5d %5d %8d %6d %8d %6d %5s %7d %6d\n",
+                      r->time, r->up_length, r->down_length, r->up_head, r->up_head_wait,
+                      r->down_head, r->down_head_wait,
+                      (r->direction==UP)?"Up":(r->direction==DOWN)?"Down":"Idle",
+                      r->on_escalator, r->boarded_count);
+    }
+    m->cfg.flight_log(m->cfg.flight_user, text);
+}
+
+// Called once at the end of every tick, after update_counters
+static void flight_record(Mall* m){
+    Customer* heads[2] = { m->upQueue->head, m->downQueue->head };
+    int waits[2];
+    for(int q=0; q<2; q++){
+        waits[q] = heads[q] ? m->current_time - heads[q]->queued_time : 0;
+        if(waits[q] > m->worst_head_queue_wait) m->worst_head_queue_wait = waits[q];
+    }
+    if(!m->flight) return;
+
+    MallFlightRecord* r = &m->flight[m->flight_next];
+    r->time = m->current_time;
+    r->up_length = m->upQueue->length;
+    r->down_length = m->downQueue->length;
+    r->up_head = heads[0] ? heads[0]->id : 0;
+    r->up_head_wait = waits[0];
+    r->down_head = heads[1] ? heads[1]->id : 0;
+    r->down_head_wait = waits[1];
+    r->direction = m->escalator->direction;
+    r->on_escalator = m->counters.on_escalator;
+    r->boarded_count = m->current_dir_boarded_count;
+    if(++m->flight_next == m->cfg.flight_ticks) m->flight_next = 0;
+    if(m->flight_count < m->cfg.flight_ticks) m->flight_count++;
+
+    if(m->cfg.flight_wait <= 0) return;
+    for(int q=0; q<2; q++){
+        if(heads[q] && waits[q] >= m->cfg.flight_wait && m->flight_dumped[q] != heads[q]->id){
+            m->flight_dumped[q] = heads[q]->id;
+            m->flight_dumps++;
+            if(m->cfg.flight_log) flight_dump(m, heads[q], waits[q]);
+        }
+    }
+}
+
+// --------------------------------------------------
+// Phase profiling
+// --------------------------------------------------
+
+/*
+ * The counters form one perf group led by the cycle counter, so a lap is a single read()
+ * of all of them. They count user space only: the read itself is not charged to a phase.
+ */
+static const struct {
+    const char* name;
+    uint64_t config;
+} hw_events[MALLSIM_HW_COUNTERS] = {
+    { "cycles",       PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache misses", PERF_COUNT_HW_CACHE_MISSES },
+};
+
+static int open_hw_event(uint64_t config, int group){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = (group < 0);   // The leader starts the group
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static long profile_clock(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Reads the group into v (events that did not open stay 0); 0 if the read failed
+static int read_hw(const MallProfile* p, unsigned long long v[MALLSIM_HW_COUNTERS]){
+    uint64_t buf[1 + MALLSIM_HW_COUNTERS];
+    if(read(p->fd[0], buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) return 0;
+    for(int e=0, i=0; e<MALLSIM_HW_COUNTERS; e++){
+        v[e] = (p->fd[e] >= 0 && (uint64_t)i < buf[0]) ? buf[1 + i++] : 0;
+    }
+    return 1;
+}
+
+static void profile_mark(MallProfile* p){
+    if(p->hardware) read_hw(p, p->last_hw);
+    p->last_ns = profile_clock();
+}
+
+// Charges everything since the last mark to 'phase'
+static void profile_lap(MallProfile* p, int phase){
+    long now = profile_clock();
+    p->ns[phase] += now - p->last_ns;
+    p->last_ns = now;
+    if(p->hardware){
+        unsigned long long v[MALLSIM_HW_COUNTERS];
+        if(read_hw(p, v)){
+            for(int e=0; e<MALLSIM_HW_COUNTERS; e++){
+                p->hw[phase][e] += (long)(v[e] - p->last_hw[e]);
+                p->last_hw[e] = v[e];
+            }
+        }
+        // The read is a system call: keep it out of the next phase's time
+        p->last_ns = profile_clock();
+    }
+}
+
+#define PROFILE_CALIBRATION 1000   // Clock reads timed to find what one costs
+
+void mallsim_profile_open(MallProfile* p, int hardware){
+    memset(p, 0, sizeof(*p));
+    for(int e=0; e<MALLSIM_HW_COUNTERS; e++) p->fd[e] = -1;
+    long start = profile_clock();
+    for(int i=0; i<PROFILE_CALIBRATION; i++) profile_clock();
+    p->clock_ns = (double)(profile_clock() - start) / (PROFILE_CALIBRATION + 1);
+    if(!hardware) return;
+    p->fd[0] = open_hw_event(hw_events[0].config, -1);
+    if(p->fd[0] < 0){
+        p->hw_error = errno;
+        return;
+    }
+    // A member the CPU does not have is left out, the rest still count
+    for(int e=1; e<MALLSIM_HW_COUNTERS; e++){
+        p->fd[e] = open_hw_event(hw_events[e].config, p->fd[0]);
+    }
+    for(int e=0; e<MALLSIM_HW_COUNTERS; e++){
+        if(p->fd[e] >= 0) p->counted |= 1 << e;
+    }
+    ioctl(p->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    p->hardware = 1;
+}
+
+void mallsim_profile_close(MallProfile* p){
+    for(int e=0; e<MALLSIM_HW_COUNTERS; e++){
+        if(p->fd[e] >= 0) close(p->fd[e]);
+        p->fd[e] = -1;
+    }
+}
+
+const char* mallsim_phase_name(int phase){
+    static const char* const names[MALLSIM_PHASES] = {
+        "operate", "status", "board up", "board down", "arrivals", "mall status"
+    };
+    return (phase >= 0 && phase < MALLSIM_PHASES) ? names[phase] : "?";
+}
+
+const char* mallsim_hw_counter_name(int counter){
+    return (counter >= 0 && counter < MALLSIM_HW_COUNTERS) ? hw_events[counter].name : "?";
+}
+
+// --------------------------------------------------
+// Public API: one mall
+// --------------------------------------------------
+void mallsim_default_config(MallConfig* cfg){
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->escalator_steps = MALLSIM_MAX_STEPS;
+    cfg->mall_capacity = 30;
+    cfg->batch_size = 5;
+    cfg->arrival_max = 2;
+    cfg->flight_ticks = 64;
+    cfg->record_block = 1024;
+    cfg->window = 60;
+    cfg->lanes = 1;
+    cfg->classes = 1;
+    for(int k=0; k<MALLSIM_MAX_CLASSES; k++){
+        cfg->class_weight[k] = 1;
+    }
+    cfg->walk_speed_max = 3;
+    cfg->overflow_policy = MALLSIM_OVERFLOW_REJECT;
+    cfg->holding_buffer = 30;
+    cfg->seed = 1;
+}
+
+const char* mallsim_check_config(const MallConfig* cfg){
+    if(cfg->escalator_steps < 1 || cfg->escalator_steps > MALLSIM_MAX_STEPS)
+        return "escalator steps must be between 1 and 13";
+    if(cfg->initial_customers < 0) return "initial customers must not be negative";
+    if(cfg->arrival_seconds < 0) return "arrival time must not be negative";
+    if(cfg->arrival_max < 0) return "arrivals per second must not be negative";
+    if(cfg->flight_ticks < 0 || cfg->flight_wait < 0) return "flight recorder settings must not be negative";
+    if(cfg->wait_bound < 0 || (cfg->wait_bound > 0 && cfg->wait_bound < 2 * cfg->escalator_steps))
+        return "wait bound must be 0 (off) or at least twice the escalator length";
+    if(cfg->records && cfg->record_block < 1) return "record blocks must hold at least 1 row";
+    if(cfg->windows && cfg->window < 1) return "windows must be at least 1 second long";
+    if(cfg->lanes < 1 || cfg->lanes > 2) return "an escalator has 1 or 2 lanes";
+    if(cfg->lanes == 2 && (cfg->walker_percent < 0 || cfg->walker_percent > 100))
+        return "walker share must be between 0 and 100 percent";
+    if(cfg->lanes == 2 && (cfg->walk_speed_max < 2 || cfg->walk_speed_max > MALLSIM_MAX_STEPS))
+        return "walking speed must be between 2 and 13 steps per tick";
+    if(cfg->classes < 1 || cfg->classes > MALLSIM_MAX_CLASSES) return "there are 1 to 4 priority classes";
+    int share = 0;
+    for(int k=0; k<cfg->classes; k++){
+        if(cfg->class_weight[k] < 1) return "class weights must be at least 1";
+        if(k > 0 && cfg->class_percent[k] < 0) return "class shares must not be negative";
+        if(k > 0) share += cfg->class_percent[k];
+    }
+    if(share > 100) return "priority classes take more than 100 percent of the customers";
+    if(cfg->outage_start < 0 || cfg->outage_length < 0 || cfg->breakdown_mtbf < 0)
+        return "outage times must not be negative";
+    if(cfg->breakdown_mtbf > 0 && cfg->breakdown_mttr < 1) return "breakdowns take at least 1 second to repair";
+    if(cfg->wait_bound > 0 && (cfg->outage_length > 0 || cfg->breakdown_mtbf > 0))
+        return "a wait bound cannot be kept while the escalator may stop (outages, breakdowns)";
+    if(cfg->mall_capacity < 0) return "mall capacity must not be negative";
+    if(cfg->batch_size < 1) return "batch size must be at least 1";
+    if(cfg->overflow_policy < MALLSIM_OVERFLOW_REJECT || cfg->overflow_policy > MALLSIM_OVERFLOW_SHED)
+        return "unknown overflow policy";
+    if(cfg->overflow_policy != MALLSIM_OVERFLOW_REJECT && cfg->holding_buffer < 1)
+        return "holding buffer size must be at least 1";
+    if(cfg->balk_length < 0 || cfg->patience < 0 || cfg->stairs_time < 0)
+        return "balk length, patience and stairs time must not be negative";
+    if(cfg->arrival_stream && (cfg->arrival_stream->initial_customers != cfg->initial_customers ||
+                               cfg->arrival_stream->seconds < cfg->arrival_seconds))
+        return "the arrival stream does not cover the initial customers and arrival time";
+    return NULL;
+}
+
+MallSim* mallsim_create(const MallConfig* cfg){
+    if(mallsim_check_config(cfg)) return NULL;
+    Mall* m = init_mall(cfg);
+    if(!m) return NULL;
+    for(int i=0; i<cfg->initial_customers; i++){
+        int dir = next_direction(m);
+        create_customer(m, dir, 0);
+    }
+    if(m->out_of_memory){
+        free_mall(m);
+        return NULL;
+    }
+    m->peak_customers = m->total_customers;
+    return m;
+}
+
+// Frees the mall and every customer still in it; also takes a partly initialised mall
+static void free_mall(Mall* m){
+    // Queued customers first (disarming their patience timers): whatever is left in
+    // the timer wheel after that is walking the stairs
+    Queue* queues[2] = { m->upQueue, m->downQueue };
+    for(int q=0; q<2; q++){
+        Customer* c;
+        while(queues[q] && (c=dequeue(queues[q]))!=NULL ){
+            disarm_timer(m, c);
+            free(c);
+        }
+    }
+    for(int i=0; m->timers && i<=m->timer_mask; i++){
+        while(m->timers[i]){
+            Customer* c = m->timers[i];
+            disarm_timer(m, c);
+            free(c);
+        }
+    }
+
+    // Clean up any remaining customers on the escalator(s)
+    Escalator* units[2] = { m->escalator, m->down_escalator };
+    for(int u=0; u<2; u++){
+        if(!units[u]) continue;
+        for(int i=0; i<MALLSIM_MAX_STEPS; i++){
+            if(units[u]->steps[i]){
+                free(units[u]->steps[i]);
+            }
+            for(int l=0; l<2; l++){
+                free(units[u]->lanes[l].riders[i]);
+            }
+        }
+        free(units[u]);
+    }
+    free(m->hold_up.arrival_times);
+    free(m->hold_down.arrival_times);
+    free(m->flight);
+    free(m->flight_text);
+    free(m->timers);
+    free(m->class_wait_hist);
+    free(m->records.column[0]);
+    free(m->upQueue);
+    free(m->downQueue);
+    free(m);
+}
+
+void mallsim_destroy(MallSim* m){
+    if(m->cfg.records) flush_records(m);
+    if(m->cfg.windows) emit_window(m);
+    free_mall(m);
+}
+
+/*
+ * One iteration of the old mall_control_loop: wake agents, operate, board up, board down,
+ * arrivals (open mall only), counters and the termination check. It is compiled twice,
+ * with and without the profile laps, and mallsim_step picks the version once per tick: a
+ * mall without a profile runs no profiling code at all.
+ */
+static inline __attribute__((always_inline)) int step_mall(Mall* m, const int profiled){
+    MallProfile* p = m->cfg.profile;
+    if(profiled) profile_mark(p);
+    LOG(m, "\n----- Time: %d sec -----\n", m->current_time);
+    if(profiled) profile_lap(p, MALLSIM_PHASE_STATUS);
+
+    // 1. Outages start, wake customers whose patience (or stair walk) ends now, then operate escalator
+    update_outage(m);
+    wake_agents(m);
+    operate_escalator(m);
+    if(profiled) profile_lap(p, MALLSIM_PHASE_OPERATE);
+
+    // 2. Escalator status
+    log_escalator_status(m);
+    if(profiled) profile_lap(p, MALLSIM_PHASE_STATUS);
+
+    // 3./4. Attempt to board the first customer in the up queue, then in the down queue
+    board_queue_head(m, m->upQueue);
+    if(profiled) profile_lap(p, MALLSIM_PHASE_BOARD_UP);
+    board_queue_head(m, m->downQueue);
+    if(profiled) profile_lap(p, MALLSIM_PHASE_BOARD_DOWN);
+
+    log_escalator_status(m);
+    if(profiled) profile_lap(p, MALLSIM_PHASE_STATUS);
+
+    // 5. Admit people waiting outside, then this second's new arrivals
+    if(m->cfg.arrival_seconds > 0){
+        generate_arrivals(m);
+    }
+    if(profiled) profile_lap(p, MALLSIM_PHASE_ARRIVALS);
+
+    // 6. Mall status
+    update_counters(m);
+    flight_record(m);
+    track_recovery(m);
+    if(m->cfg.windows) roll_window(m);
+    m->ticks++;
+    LOG(m, "Mall status: Total customers = %d, upQ = %d, downQ = %d, On escalator = %d\n",
+        m->total_customers,
+        m->upQueue->length,
+        m->downQueue->length,
+        m->counters.on_escalator);
+
+    // 7. Termination condition: nobody inside, nobody waiting outside, no more arrivals
+    int more = 1;
+    if(m->current_time >= m->cfg.arrival_seconds && m->total_customers == 0 &&
+       m->hold_up.length == 0 && m->hold_down.length == 0){
+        m->finished = 1;
+        if(m->cfg.records) flush_records(m);
+        if(m->cfg.windows) emit_window(m);
+        more = 0;
+    } else {
+        m->current_time++;
+    }
+    if(profiled){
+        profile_lap(p, MALLSIM_PHASE_MALL);
+        p->ticks++;
+    }
+    return more;
+}
+
+int mallsim_step(MallSim* m){
+    if(m->out_of_memory) return -1;
+    if(m->finished) return 0;
+    int more = m->cfg.profile ? step_mall(m, 1) : step_mall(m, 0);
+    return m->out_of_memory ? -1 : more;
+}
+
+int mallsim_time(const MallSim* m){
+    return m->current_time;
+}
+
+const MallCounters* mallsim_counters(const MallSim* m){
+    return &m->counters;
+}
+
+void mallsim_result(const MallSim* m, MallResult* out){
+    out->ticks = m->ticks;
+    out->completed = m->completed_customers;
+    out->remaining = m->total_customers;
+    out->peak_customers = m->peak_customers;
+    out->total_turnaround = m->total_turnaround_time;
+    out->total_wait = m->total_wait_time;
+    out->checksum = m->completion_checksum;
+    out->balked = m->balked;
+    out->reneged = m->reneged;
+    out->rerouted = m->rerouted;
+    out->agent_resumes = m->agent_resumes;
+    out->arrivals = m->arrivals;
+    out->admitted = m->admitted;
+    out->deferred = m->deferred;
+    out->rejected = m->rejected;
+    out->shed = m->shed;
+    out->still_outside = m->hold_up.length + m->hold_down.length;
+    out->outside_wait = m->outside_wait;
+    out->flight_dumps = m->flight_dumps;
+    out->worst_head_queue_wait = m->worst_head_queue_wait;
+    out->worst_front_wait = m->worst_front_wait;
+    out->bound_holds = m->bound_holds;
+    out->bound_switches = m->bound_switches;
+    out->walkers = m->walkers;
+    out->outages = m->outages;
+    out->outage_episodes = m->outage_episodes;
+    out->outage_recoveries = m->outage_recoveries;
+    out->outage_unmeasured = m->outage_unmeasured;
+    out->outage_recovery_total = m->outage_recovery_total;
+    out->outage_recovery_worst = m->outage_recovery_worst;
+    out->outage_peak_queue = m->outage_peak_queue;
+    out->outage_peak_wait = m->outage_peak_wait;
+    out->outage_wait = m->outage_wait;
+    out->outage_boardings = m->outage_boardings;
+    for(int k=0; k<m->cfg.classes; k++){
+        out->class_customers[k] = m->class_customers[k];
+        out->class_boarded[k] = m->class_boarded[k];
+        out->class_wait[k] = m->class_wait[k];
+        out->class_wait_max[k] = m->class_wait_max[k];
+        if(m->class_wait_hist){
+            memcpy(out->class_wait_hist[k], m->class_wait_hist + k * MALLSIM_HIST_BUCKETS, sizeof(out->class_wait_hist[k]));
+        }
+    }
+    out->counters = m->counters;
+    memcpy(out->wait_hist, m->wait_hist, sizeof(out->wait_hist));
+    memcpy(out->turnaround_hist, m->turnaround_hist, sizeof(out->turnaround_hist));
+}
+
+const char* mallsim_record_column(int col){
+    static const char* const names[MALLSIM_RECORD_COLUMNS] = {
+        "id", "direction", "arrival", "board", "wait", "finish", "outcome", "class"
+    };
+    return (col >= 0 && col < MALLSIM_RECORD_COLUMNS) ? names[col] : NULL;
+}
+
+int mallsim_flight_records(const MallSim* m, MallFlightRecord* out, int max){
+    if(!m->flight) return 0;
+    int n = (m->flight_count < max) ? m->flight_count : max;
+    int first = (m->flight_next - n + m->cfg.flight_ticks) % m->cfg.flight_ticks;
+    for(int i=0; i<n; i++){
+        out[i] = m->flight[(first + i) % m->cfg.flight_ticks];
+    }
+    return n;
+}
+
+int mallsim_run(const MallConfig* cfg, MallResult* out){
+    MallSim* m = mallsim_create(cfg);
+    if(!m) return -1;
+    int more;
+    while((more = mallsim_step(m)) > 0) { }
+    mallsim_result(m, out);
+    mallsim_destroy(m);
+    return more;
+}
+
+MallArrivals* mallsim_arrivals_create(const MallConfig* cfg){
+    if(mallsim_check_config(cfg)) return NULL;
+    MallArrivals* a = (MallArrivals*)malloc(sizeof(MallArrivals));
+    if(!a) return NULL;
+    a->initial_customers = cfg->initial_customers;
+    a->seconds = cfg->arrival_seconds;
+    // At least the initial customers; grown while the timed arrivals are drawn
+    long count = 0, capacity = cfg->initial_customers + 2L * cfg->arrival_seconds + 1;
+    a->per_second = (int*)malloc(sizeof(int) * (cfg->arrival_seconds + 1));
+    a->direction = (signed char*)malloc(capacity);
+    if(!a->per_second || !a->direction){
+        mallsim_arrivals_destroy(a);
+        return NULL;
+    }
+    Rng rng;
+    rng_seed(&rng, cfg->seed);
+    for(int i=0; i<cfg->initial_customers; i++){
+        a->direction[count++] = (signed char)draw_direction(&rng);
+    }
+    for(int t=0; t<cfg->arrival_seconds; t++){
+        int n = rng_next(&rng) % (cfg->arrival_max + 1);
+        a->per_second[t] = n;
+        if(count + n > capacity){
+            capacity = 2 * capacity + n;
+            signed char* grown = (signed char*)realloc(a->direction, capacity);
+            if(!grown){
+                mallsim_arrivals_destroy(a);
+                return NULL;
+            }
+            a->direction = grown;
+        }
+        for(int i=0; i<n; i++){
+            a->direction[count++] = (signed char)draw_direction(&rng);
+        }
+    }
+    return a;
+}
+
+void mallsim_arrivals_destroy(MallArrivals* a){
+    if(!a) return;
+    free(a->per_second);
+    free(a->direction);
+    free(a);
+}
+
+// --------------------------------------------------
+// Kernel microbenchmark
+// --------------------------------------------------
+
+// The per-direction loops advance_riders replaced, kept only for mallsim_kernel_workload
+static Customer* legacy_advance(Escalator* e, int direction, int steps){
+    Customer* leaving = NULL;
+    if(direction==UP){
+        if(e->steps[steps-1]){
+            leaving = e->steps[steps-1];
+            e->steps[steps-1] = NULL;
+        }
+        for(int i=steps-2; i>=0; i--){
+            if(e->steps[i]){
+                e->steps[i+1]=e->steps[i];
+                e->steps[i]=NULL;
+            }
+        }
+    } else if(direction==DOWN){
+        if(e->steps[0]){
+            leaving = e->steps[0];
+            e->steps[0] = NULL;
+        }
+        for(int i=1; i<steps; i++){
+            if(e->steps[i]){
+                e->steps[i-1]=e->steps[i];
+                e->steps[i]=NULL;
+            }
+        }
+    }
+    return leaving;
+}
+
+/*
+ * Synthetic stepping traffic: every tick the escalator moves, the rider stepping off is
+ * recycled, a new rider boards about every other tick and the direction flips every 32
+ * ticks. Returns a checksum of who left when, which is the same for both implementations.
+ */
+long mallsim_kernel_workload(int steps, long ticks, int legacy){
+    if(steps < 1 || steps > MALLSIM_MAX_STEPS) return -1;
+    Escalator* e = init_escalator(IDLE, steps);
+    Customer riders[MALLSIM_MAX_STEPS + 1];
+    Customer* free_riders[MALLSIM_MAX_STEPS + 1];
+    int num_free = 0;
+    for(int i=0; i<=MALLSIM_MAX_STEPS; i++){
+        riders[i].id = i + 1;
+        free_riders[num_free++] = &riders[i];
+    }
+    unsigned int x = 2463534242u;
+    long checksum = 0;
+    int direction = UP;
+    for(long t=0; t<ticks; t++){
+        if((t & 31) == 0) direction = -direction;
+        Customer* c = legacy ? legacy_advance(e, direction, steps) : e->advance[direction == UP](e);
+        if(c){
+            free_riders[num_free++] = c;
+            checksum = checksum * 31 + c->id;
+        }
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        if((x & 1) && num_free > 0){
+            int entry = legacy ? ((direction==UP)? 0 : steps - 1) : e->entry[direction == UP];
+            e->steps[entry] = free_riders[--num_free];
+        }
+    }
+    free(e);
+    return checksum;
+}
+
+// --------------------------------------------------
+// Batch engine: small closed malls in lockstep
+// --------------------------------------------------
+
+/*
+ * A field of MALLSIM_BATCH_LANES instances, lane i belonging to instance i of the block.
+ * Comparisons give -1 (true) or 0 per lane, so each decision of the scalar engine becomes
+ * a mask and each "if" a blend; the compiler maps the operations to the vector unit.
+ */
+typedef int32_t BatchVec __attribute__((vector_size(MALLSIM_BATCH_LANES * sizeof(int32_t))));
+
+#define BATCH_SELECT(mask, a, b) (((mask) & (a)) | (~(mask) & (b)))
+
+// rng_seed/rng_next for a lane each: the same additive feedback, one vector add per draw
+typedef uint32_t BatchRngVec __attribute__((vector_size(MALLSIM_BATCH_LANES * sizeof(uint32_t))));
+
+typedef struct {
+    BatchRngVec state[31];
+    int f;
+    int r;
+} BatchRng;
+
+static BatchRngVec batch_rng_next(BatchRng* g){
+    BatchRngVec val = g->state[g->f] + g->state[g->r];
+    g->state[g->f] = val;
+    if(++g->f >= 31){
+        g->f = 0;
+        g->r++;
+    } else if(++g->r >= 31){
+        g->r = 0;
+    }
+    return val >> 1;
+}
+
+static void batch_rng_seed(BatchRng* g, const unsigned int* seeds){
+    for(int l=0; l<MALLSIM_BATCH_LANES; l++){
+        int32_t state[31];
+        rng_fill(state, seeds[l]);
+        for(int i=0; i<31; i++){
+            g->state[i][l] = (uint32_t)state[i];
+        }
+    }
+    g->f = 3;
+    g->r = 0;
+    for(int i=0; i<310; i++){
+        batch_rng_next(g);
+    }
+}
+
+typedef struct {
+    BatchVec occupied;        // Bit i set while somebody stands on step i
+    BatchVec direction;
+    BatchVec last_direction;
+    BatchVec boarded_count;
+    BatchVec up_length;
+    BatchVec down_length;
+    BatchVec riders;
+    BatchVec steps;
+    BatchVec all_steps;       // (1 << steps) - 1
+    BatchVec top;             // 1 << (steps - 1): where up riders leave and down riders board
+    BatchVec batch;
+    BatchVec running;         // -1 until the instance's mall is empty
+    BatchVec ticks;
+    BatchVec completed;
+    BatchVec turnaround;
+    BatchVec wait;
+    BatchVec switches;
+} BatchBlock;
+
+static int batch_supports(const MallConfig* cfg){
+    return !mallsim_check_config(cfg) && cfg->arrival_seconds == 0 && !cfg->pair &&
+           cfg->lanes == 1 && cfg->classes == 1 && cfg->wait_bound == 0 &&
+           cfg->outage_length == 0 && cfg->breakdown_mtbf == 0 &&
+           cfg->balk_length == 0 && cfg->patience == 0 && !cfg->arrival_stream &&
+           cfg->initial_customers <= MALLSIM_BATCH_MAX_CUSTOMERS;
+}
+
+// can_customer_board + board_customer for the head of one queue; board gets where it boarded
+static inline __attribute__((always_inline)) void batch_board(BatchBlock* b, int32_t t, int dir, BatchVec* length,
+                                                              const BatchVec* opposite, const BatchVec* entry, BatchVec* board){
+    BatchVec ready = b->running & (*length > 0) & (b->riders < b->steps);
+
+    // An idle escalator takes the head's direction
+    BatchVec idle = ready & (b->direction == IDLE);
+    b->switches -= idle & (b->last_direction != IDLE) & (b->last_direction != dir);
+    b->direction = BATCH_SELECT(idle, dir, b->direction);
+    b->last_direction = BATCH_SELECT(idle, dir, b->last_direction);
+    b->boarded_count &= ~idle;
+
+    // Its way: board, unless a full batch has gone and the opposite queue waits
+    *board = ready & (b->direction == dir) & ~((*opposite > 0) & (b->boarded_count >= b->batch));
+    b->occupied |= *board & *entry;
+    b->riders -= *board;
+    b->boarded_count -= *board;
+    *length += *board;
+    b->wait += t & *board;
+}
+
+// One mallsim_step of every instance of the block; boarded gets 1 (up), 2 (down) or 0 per lane
+static void batch_tick(BatchBlock* b, int32_t t, BatchVec* boarded){
+    // 1. Operate: everybody moves a step, up riders leave from the top step, down riders from step 0
+    BatchVec moving = b->running & (b->riders > 0);
+    BatchVec up = moving & (b->direction == UP);
+    BatchVec down = moving & (b->direction == DOWN);
+    BatchVec leaving = (up & ((b->occupied & b->top) != 0)) | (down & ((b->occupied & 1) != 0));
+    b->occupied = BATCH_SELECT(up, (b->occupied << 1) & b->all_steps,
+                               BATCH_SELECT(down, b->occupied >> 1, b->occupied));
+    b->riders += leaving;
+    b->completed -= leaving;
+    b->turnaround += t & leaving;   // Everybody arrived at 0
+
+    // Empty: switch to a waiting opposite queue after a full batch, otherwise go idle
+    BatchVec emptied = moving & (b->riders == 0);
+    BatchVec opposite = BATCH_SELECT(up, b->down_length, b->up_length);
+    BatchVec flip = emptied & (b->boarded_count >= b->batch) & (opposite > 0);
+    b->direction = BATCH_SELECT(flip, -b->direction, ~emptied & b->direction);
+    b->last_direction = BATCH_SELECT(flip, b->direction, b->last_direction);
+    b->switches -= flip;
+    b->boarded_count &= ~emptied;
+
+    // 3./4. The up head, then the down head
+    BatchVec bottom = b->top - b->top + 1;
+    BatchVec up_board, down_board;
+    batch_board(b, t, UP, &b->up_length, &b->down_length, &bottom, &up_board);
+    batch_board(b, t, DOWN, &b->down_length, &b->up_length, &b->top, &down_board);
+    *boarded = (up_board & 1) | (down_board & 2);
+
+    // 7. Done once nobody is left, this tick included
+    BatchVec finished = b->running & ((b->up_length + b->down_length + b->riders) == 0);
+    b->ticks = BATCH_SELECT(finished, t + 1, b->ticks);
+    b->running &= ~finished;
+}
+
+/*
+ * Every instance draws its customers' directions from its seed like mallsim_create. The
+ * checksum is left to a scalar pass over the boardings: nobody can overtake on the
+ * escalator, so riders step off in boarding order, each exactly 'steps' ticks after it
+ * boarded, and the boarding ticks say who completed when.
+ */
+int mallsim_batch_run(const MallConfig* cfgs, int n, MallBatchResult* out){
+    for(int i=0; i<n; i++){
+        if(!batch_supports(&cfgs[i])) return -1;
+    }
+    int capacity = 0;
+    BatchVec* boarded = NULL;
+    for(int base=0; base<n; base+=MALLSIM_BATCH_LANES){
+        int lanes = (n - base < MALLSIM_BATCH_LANES) ? n - base : MALLSIM_BATCH_LANES;
+        BatchBlock b;
+        memset(&b, 0, sizeof(b));
+        uint64_t up_ids[MALLSIM_BATCH_LANES] = { 0 };
+        uint64_t down_ids[MALLSIM_BATCH_LANES] = { 0 };
+        unsigned int seeds[MALLSIM_BATCH_LANES];
+        int customers = 0;
+        int bound = 1;
+        for(int l=0; l<MALLSIM_BATCH_LANES; l++){
+            const MallConfig* cfg = &cfgs[base + ((l < lanes) ? l : 0)];
+            b.steps[l] = cfg->escalator_steps;
+            b.all_steps[l] = (1 << cfg->escalator_steps) - 1;
+            b.top[l] = 1 << (cfg->escalator_steps - 1);
+            b.batch[l] = cfg->batch_size;
+            seeds[l] = cfg->seed;
+            if(l >= lanes) continue;
+            b.running[l] = -1;
+            if(cfg->initial_customers > customers) customers = cfg->initial_customers;
+            // Each boarding follows the previous one within 'steps' ticks
+            int ticks = (cfg->initial_customers + 1) * (cfg->escalator_steps + 1);
+            if(ticks > bound) bound = ticks;
+        }
+
+        // Customer i + 1 goes up if draw i is even, as in mallsim_create
+        BatchRng rng;
+        batch_rng_seed(&rng, seeds);
+        for(int i=0; i<customers; i++){
+            BatchRngVec draw = batch_rng_next(&rng);
+            for(int l=0; l<lanes; l++){
+                if(i >= cfgs[base + l].initial_customers) continue;
+                if(draw[l] % 2 == 0) up_ids[l] |= (uint64_t)1 << i;
+                else down_ids[l] |= (uint64_t)1 << i;
+            }
+        }
+        for(int l=0; l<lanes; l++){
+            b.up_length[l] = __builtin_popcountll(up_ids[l]);
+            b.down_length[l] = __builtin_popcountll(down_ids[l]);
+        }
+
+        int t = 0;
+        for(BatchVec running = b.running; ; t++){
+            int any = 0;
+            for(int l=0; l<MALLSIM_BATCH_LANES; l++) any |= running[l];
+            if(!any) break;
+            if(t == capacity){
+                capacity = (capacity > bound) ? 2 * capacity : 2 * bound;
+                BatchVec* grown = (BatchVec*)realloc(boarded, sizeof(BatchVec) * capacity);
+                if(!grown){
+                    free(boarded);
+                    return -1;
+                }
+                boarded = grown;
+            }
+            batch_tick(&b, t, &boarded[t]);
+            running = b.running;
+        }
+
+        for(int l=0; l<lanes; l++){
+            MallBatchResult* r = &out[base + l];
+            r->ticks = b.ticks[l];
+            r->completed = b.completed[l];
+            r->total_turnaround = b.turnaround[l];
+            r->total_wait = b.wait[l];
+            r->direction_switches = b.switches[l];
+            r->checksum = 0;
+            for(int tick=0; tick<r->ticks; tick++){
+                int code = boarded[tick][l];
+                if(!code) continue;
+                uint64_t* ids = (code == 1) ? &up_ids[l] : &down_ids[l];
+                unsigned long id = (unsigned long)__builtin_ctzll(*ids) + 1;
+                *ids &= *ids - 1;
+                r->checksum = r->checksum * 1000003UL + id * 131UL + (unsigned long)(tick + b.steps[l]);
+            }
+        }
+    }
+    free(boarded);
+    return 0;
+}
+
+int mallsim_percentile(const int* hist, double p){
+    long total = 0;
+    for(int i=0; i<MALLSIM_HIST_BUCKETS; i++) total += hist[i];
+    if(total == 0) return 0;
+    long rank = (long)(p / 100.0 * total + 0.999999);
+    if(rank < 1) rank = 1;
+    long seen = 0;
+    for(int i=0; i<MALLSIM_HIST_BUCKETS; i++){
+        seen += hist[i];
+        if(seen >= rank) return i;
+    }
+    return MALLSIM_HIST_BUCKETS - 1;
+}
+
+size_t mallsim_agent_size(void){
+    return sizeof(Customer);
+}
+
+double mallsim_t95(int df){
+    static const double table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if(df < 1) return 0.0;
+    if(df <= 30) return table[df-1];
+    return 1.960 + 2.5 / df;   // Within 0.002 of the exact quantile beyond 30
+}
+
+void mallsim_mean_halfwidth(const double* v, int n, double* mean, double* half){
+    double sum = 0.0;
+    for(int i=0; i<n; i++) sum += v[i];
+    *mean = (n > 0) ? sum / n : 0.0;
+    double ss = 0.0;
+    for(int i=0; i<n; i++) ss += (v[i] - *mean) * (v[i] - *mean);
+    *half = (n > 1) ? mallsim_t95(n - 1) * sqrt(ss / (n - 1)) / sqrt((double)n) : INFINITY;
+}
+
+// --------------------------------------------------
+// Building: several escalators stepped in parallel
+// --------------------------------------------------
+
+/*
+ * Every customer starts on a random floor and wants to reach another random floor, so
+ * the population is generated sequentially from the seed before any worker starts: the
+ * same seed gives the same building regardless of the thread count.
+ */
+MallBuilding* mallsim_building_create(const MallConfig* cfg, int num_escalators, int customers_per_escalator){
+    if(mallsim_check_config(cfg) || num_escalators < 1 || customers_per_escalator < 0) return NULL;
+    MallBuilding* b = (MallBuilding*)malloc(sizeof(MallBuilding));
+    if(!b) return NULL;
+    b->cfg = *cfg;
+    b->cfg.initial_customers = 0;
+    b->cfg.arrival_seconds = 0;
+    b->cfg.log = NULL;
+    b->cfg.trace = NULL;
+    b->cfg.windows = NULL;
+    b->cfg.arrival_stream = NULL;
+    b->cfg.profile = NULL;
+    b->num_escalators = num_escalators;
+    b->malls = (Mall**)calloc(num_escalators, sizeof(Mall*));
+    if(!b->malls){
+        free(b);
+        return NULL;
+    }
+    b->last_customer_id = 0;
+    for(int k=0; k<num_escalators; k++){
+        b->malls[k] = init_mall(&b->cfg);
+        if(!b->malls[k]){
+            mallsim_building_destroy(b);
+            return NULL;
+        }
+        b->malls[k]->customer_id = &b->last_customer_id;
+        rng_seed(&b->malls[k]->agent_rng, agent_seed(cfg->seed, k));
+        rng_seed(&b->malls[k]->speed_rng, stream_seed(cfg->seed, SPEED_STREAM, k));
+        rng_seed(&b->malls[k]->outage_rng, stream_seed(cfg->seed, OUTAGE_STREAM, k));
+        rng_seed(&b->malls[k]->class_rng, stream_seed(cfg->seed, CLASS_STREAM, k));
+    }
+    b->num_threads = 0;
+    b->remaining = NULL;
+    b->ticks = 0;
+
+    Rng rng;
+    rng_seed(&rng, cfg->seed);
+    int floors = num_escalators + 1;
+    for(int i=0; i<num_escalators * customers_per_escalator; i++){
+        int from = rng_next(&rng) % floors;
+        int to   = rng_next(&rng) % (floors - 1);
+        if(to >= from) to++;
+
+        int dir = (to > from) ? UP : DOWN;
+        Mall* m = b->malls[(dir == UP) ? from : from - 1];
+        Customer* c = create_customer_struct(m, dir, 0);
+        if(!c){
+            mallsim_building_destroy(b);
+            return NULL;
+        }
+        c->remaining_rides = (dir == UP) ? to - from - 1 : from - to - 1;
+        start_customer_agent(m, c);
+    }
+    for(int k=0; k<num_escalators; k++){
+        b->malls[k]->peak_customers = b->malls[k]->total_customers;
+    }
+    return b;
+}
+
+// Phase 2 of a tick: take the riders the neighbouring escalators handed over
+static void receive_transfers(MallBuilding* b, int k){
+    Mall* m = b->malls[k];
+    if(k > 0){
+        Mall* below = b->malls[k-1];
+        for(int i=0; i<below->transfers; i++){
+            Customer* c = below->transfer_out[i];
+            if(c->direction != UP) continue;
+            c->queued_time = m->current_time;
+            enqueue(m, m->upQueue, c);
+            m->total_customers++;
+        }
+    }
+    if(k < b->num_escalators - 1){
+        Mall* above = b->malls[k+1];
+        for(int i=0; i<above->transfers; i++){
+            Customer* c = above->transfer_out[i];
+            if(c->direction != DOWN) continue;
+            c->queued_time = m->current_time;
+            enqueue(m, m->downQueue, c);
+            m->total_customers++;
+        }
+    }
+}
+
+/*
+ * Each tick has two phases separated by a barrier:
+ *   1. operate + board: each worker runs steps 1, 3 and 4 of mallsim_step on its own escalators;
+ *      riders leaving for another floor are parked in Mall.transfer_out.
+ *   2. arrivals: each escalator pulls the riders parked by its neighbours into its queues.
+ * A mall is only ever written by its owner, and neighbours' slots are only read after the
+ * barrier, so the outcome does not depend on the partitioning.
+ */
+static void* building_worker(void* arg){
+    BuildingWorker* w = (BuildingWorker*)arg;
+    MallBuilding* b = w->b;
+    int tick = 0;
+    pthread_mutex_lock(&b->start);
+    int aborted = b->aborted;
+    pthread_mutex_unlock(&b->start);
+    if(aborted) return NULL;
+
+    while(1){
+        for(int k=w->first; k<w->last; k++){
+            Mall* m = b->malls[k];
+            m->current_time = tick;
+            m->transfers = 0;
+            update_outage(m);
+            wake_agents(m);
+            operate_escalator(m);
+            board_queue_head(m, m->upQueue);
+            board_queue_head(m, m->downQueue);
+            update_counters(m);
+            flight_record(m);
+            track_recovery(m);
+            m->ticks++;
+        }
+        pthread_barrier_wait(&b->barrier);
+
+        int remaining = 0;
+        for(int k=w->first; k<w->last; k++){
+            receive_transfers(b, k);
+            remaining += b->malls[k]->total_customers;
+        }
+        b->remaining[w->index] = remaining;
+        pthread_barrier_wait(&b->barrier);
+
+        // Every worker reaches the same verdict; remaining[] is not written again before the next barrier
+        int total = 0;
+        for(int i=0; i<b->num_threads; i++){
+            total += b->remaining[i];
+        }
+        if(total == 0) break;
+        tick++;
+    }
+
+    if(w->index == 0){
+        b->ticks = tick + 1;
+    }
+    return NULL;
+}
+
+int mallsim_building_run(MallBuilding* b, int num_threads){
+    if(num_threads > b->num_escalators) num_threads = b->num_escalators;
+    if(num_threads < 1) num_threads = 1;
+
+    b->remaining = (int*)calloc(num_threads, sizeof(int));
+    BuildingWorker* workers = (BuildingWorker*)malloc(sizeof(BuildingWorker) * num_threads);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * num_threads);
+    if(!b->remaining || !workers || !threads){
+        free(threads);
+        free(workers);
+        free(b->remaining);
+        b->remaining = NULL;
+        return -1;
+    }
+
+    // The workers wait at the start gate until all of them exist. If one cannot be created,
+    // those that were are sent home and the calling thread runs the building alone: the
+    // result is the same for any number of threads.
+    int started = 0;
+    b->num_threads = num_threads;
+    b->aborted = 0;
+    pthread_mutex_init(&b->start, NULL);
+    if(num_threads > 1){
+        pthread_mutex_lock(&b->start);
+        pthread_barrier_init(&b->barrier, NULL, num_threads);
+        for(int i=0; i<num_threads; i++){
+            workers[i].b = b;
+            workers[i].index = i;
+            workers[i].first = (int)((long)b->num_escalators * i / num_threads);
+            workers[i].last  = (int)((long)b->num_escalators * (i+1) / num_threads);
+            if(pthread_create(&threads[i], NULL, building_worker, &workers[i]) != 0) break;
+            started++;
+        }
+        b->aborted = started < num_threads;
+        pthread_mutex_unlock(&b->start);
+        for(int i=0; i<started; i++){
+            pthread_join(threads[i], NULL);
+        }
+        pthread_barrier_destroy(&b->barrier);
+    }
+    if(started < num_threads){
+        num_threads = b->num_threads = 1;
+        b->aborted = 0;
+        workers[0].b = b;
+        workers[0].index = 0;
+        workers[0].first = 0;
+        workers[0].last = b->num_escalators;
+        pthread_barrier_init(&b->barrier, NULL, 1);
+        building_worker(&workers[0]);
+        pthread_barrier_destroy(&b->barrier);
+    }
+    pthread_mutex_destroy(&b->start);
+    // The last rows of every escalator, in escalator order
+    if(b->cfg.records){
+        for(int k=0; k<b->num_escalators; k++){
+            flush_records(b->malls[k]);
+        }
+    }
+    free(threads);
+    free(workers);
+    free(b->remaining);
+    b->remaining = NULL;
+    return num_threads;
+}
+
+const MallCounters* mallsim_building_counters(const MallBuilding* b, int escalator){
+    return &b->malls[escalator]->counters;
+}
+
+// Totals are summed in escalator order, so they are identical for every thread count
+int mallsim_building_result(const MallBuilding* b, MallResult* out){
+    memset(out, 0, sizeof(*out));
+    MallResult* r = (MallResult*)malloc(sizeof(MallResult));
+    if(!r) return -1;
+    for(int k=0; k<b->num_escalators; k++){
+        mallsim_result(b->malls[k], r);
+        out->completed        += r->completed;
+        out->remaining        += r->remaining;
+        if(r->peak_customers > out->peak_customers) out->peak_customers = r->peak_customers;
+        out->total_turnaround += r->total_turnaround;
+        out->total_wait       += r->total_wait;
+        out->checksum          = out->checksum * 31UL + r->checksum;
+        out->balked           += r->balked;
+        out->reneged          += r->reneged;
+        out->rerouted         += r->rerouted;
+        out->agent_resumes    += r->agent_resumes;
+        out->flight_dumps     += r->flight_dumps;
+        if(r->worst_head_queue_wait > out->worst_head_queue_wait) out->worst_head_queue_wait = r->worst_head_queue_wait;
+        if(r->worst_front_wait > out->worst_front_wait) out->worst_front_wait = r->worst_front_wait;
+        out->bound_holds      += r->bound_holds;
+        out->bound_switches   += r->bound_switches;
+        out->walkers          += r->walkers;
+        out->outages          += r->outages;
+        out->outage_episodes  += r->outage_episodes;
+        out->outage_recoveries += r->outage_recoveries;
+        out->outage_unmeasured += r->outage_unmeasured;
+        out->outage_recovery_total += r->outage_recovery_total;
+        if(r->outage_recovery_worst > out->outage_recovery_worst) out->outage_recovery_worst = r->outage_recovery_worst;
+        if(r->outage_peak_queue > out->outage_peak_queue) out->outage_peak_queue = r->outage_peak_queue;
+        if(r->outage_peak_wait > out->outage_peak_wait) out->outage_peak_wait = r->outage_peak_wait;
+        out->outage_wait      += r->outage_wait;
+        out->outage_boardings += r->outage_boardings;
+        for(int c=0; c<b->cfg.classes; c++){
+            out->class_customers[c] += r->class_customers[c];
+            out->class_boarded[c]   += r->class_boarded[c];
+            out->class_wait[c]      += r->class_wait[c];
+            if(r->class_wait_max[c] > out->class_wait_max[c]) out->class_wait_max[c] = r->class_wait_max[c];
+            if(b->cfg.classes > 1){
+                for(int i=0; i<MALLSIM_HIST_BUCKETS; i++){
+                    out->class_wait_hist[c][i] += r->class_wait_hist[c][i];
+                }
+            }
+        }
+
+        MallCounters* s = &out->counters;
+        const MallCounters* c = &r->counters;
+        s->ticks               += c->ticks;
+        s->boarded             += c->boarded;
+        s->completed           += c->completed;
+        s->occupied_step_ticks += c->occupied_step_ticks;
+        s->step_ticks          += c->step_ticks;
+        s->idle_unit_ticks     += c->idle_unit_ticks;
+        s->unit_ticks          += c->unit_ticks;
+        s->idle_ticks          += c->idle_ticks;
+        s->direction_switches  += c->direction_switches;
+        s->drain_ticks         += c->drain_ticks;
+        s->outage_ticks        += c->outage_ticks;
+        s->up_queue_length     += c->up_queue_length;
+        s->down_queue_length   += c->down_queue_length;
+        s->on_escalator        += c->on_escalator;
+        if(c->peak_up_queue > s->peak_up_queue) s->peak_up_queue = c->peak_up_queue;
+        if(c->peak_down_queue > s->peak_down_queue) s->peak_down_queue = c->peak_down_queue;
+
+        for(int i=0; i<MALLSIM_HIST_BUCKETS; i++){
+            out->wait_hist[i] += r->wait_hist[i];
+            out->turnaround_hist[i] += r->turnaround_hist[i];
+        }
+    }
+    out->ticks = b->ticks;
+    free(r);
+    return 0;
+}
+
+void mallsim_building_destroy(MallBuilding* b){
+    for(int k=0; k<b->num_escalators; k++){
+        if(b->malls[k]) mallsim_destroy(b->malls[k]);
+    }
+    free(b->malls);
+    free(b);
+}
@@ -0,0 +1,586 @@
+#ifndef MALLSIM_H
+#define MALLSIM_H
+
+#include <stddef.h>
+
+/*
+ * Escalator simulation engine (the logic of sample7.c/sample8.c as a library).
+ *
+ * A MallSim is one mall: a reversible escalator (or a one-way pair) with its up and
+ * down queues, simulated in virtual time one tick (second) at a time. Everything an
+ * instance uses lives in the instance: configuration, random streams, customer ids,
+ * counters and histograms. Instances are independent, so any number of them may run
+ * at once on different threads; a single instance must not be used by two threads at
+ * the same time (except for reading its live counters, see mallsim_counters).
+ *
+ * The engine never writes to stdout. Per-tick log lines, if wanted, are handed to the
+ * MallConfig.log callback; results come back in a MallResult.
+ */
+
+#define MALLSIM_UP    1
+#define MALLSIM_DOWN -1
+#define MALLSIM_IDLE  0
+
+#define MALLSIM_MAX_STEPS 13
+
+// Admission policies for timed arrivals that find the mall full
+#define MALLSIM_OVERFLOW_REJECT 0   // Turn the arrival away
+#define MALLSIM_OVERFLOW_DEFER  1   // Wait outside in a bounded per-direction buffer
+#define MALLSIM_OVERFLOW_SHED   2   // Like DEFER, but shed with probability = buffer fill ratio
+
+// Waits and turnaround times of MALLSIM_HIST_BUCKETS-1 seconds or more share the last bucket
+#define MALLSIM_HIST_BUCKETS 1024
+
+// Priority classes (MallConfig.classes); class 0 is everybody without priority
+#define MALLSIM_MAX_CLASSES 4
+
+typedef void (*MallLogFn)(void* user, const char* text);
+
+/*
+ * Per-customer records, one row per customer once it is done (rode, took the stairs,
+ * gave up or balked), handed over in column blocks: column[MALLSIM_COL_*][row]. Customers
+ * turned away before entering the mall have no row (see MallResult.rejected / shed).
+ */
+#define MALLSIM_COL_ID        0
+#define MALLSIM_COL_DIRECTION 1   // MALLSIM_UP / MALLSIM_DOWN
+#define MALLSIM_COL_ARRIVAL   2   // Second the customer entered the mall
+#define MALLSIM_COL_BOARD     3   // Second of its first boarding, -1 if it never boarded
+#define MALLSIM_COL_WAIT      4   // Seconds queued, over every escalator it rode
+#define MALLSIM_COL_FINISH    5   // Second it stepped off for the last time or left (turnaround = finish - arrival)
+#define MALLSIM_COL_OUTCOME   6   // MALLSIM_OUTCOME_*
+#define MALLSIM_COL_CLASS     7   // Priority class
+#define MALLSIM_RECORD_COLUMNS 8
+
+#define MALLSIM_OUTCOME_RODE    0
+#define MALLSIM_OUTCOME_STAIRS  1
+#define MALLSIM_OUTCOME_RENEGED 2
+#define MALLSIM_OUTCOME_BALKED  3
+
+typedef struct {
+    int rows;
+    int* column[MALLSIM_RECORD_COLUMNS];
+} MallRecordBlock;
+
+typedef void (*MallRecordFn)(void* user, const MallRecordBlock* block);
+
+/*
+ * Event trace: what the original programs printed as they went, as structured events in
+ * the order they happened. Two engines agree on a scenario when their traces are equal
+ * event by event (see mallsim_reference_run).
+ */
+#define MALLSIM_EVENT_ENTER     0   // Joined its queue; value = second it arrived
+#define MALLSIM_EVENT_BOARD     1   // value = seconds queued
+#define MALLSIM_EVENT_FINISH    2   // Done riding (or walking the stairs); value = turnaround
+#define MALLSIM_EVENT_DIRECTION 3   // The reversible escalator takes a direction, MALLSIM_IDLE once it
+                                    // stops; customer 0, value = boardings in the direction it leaves
+
+typedef struct {
+    int time;
+    int kind;                 // MALLSIM_EVENT_*
+    int customer;             // Customer id
+    int direction;
+    int value;
+} MallEvent;
+
+typedef void (*MallTraceFn)(void* user, const MallEvent* event);
+
+/*
+ * Time series: the run is cut into windows of MallConfig.window seconds, each rolled up
+ * tick by tick as the run goes (the instance keeps only the window it is in) and handed
+ * to MallConfig.windows as soon as it is complete; the last one when the run ends, however
+ * short. Queue lengths are sampled at the end of each tick.
+ */
+typedef struct {
+    int start;                // First second of the window
+    int ticks;                // Seconds it covers
+    int arrivals;             // Timed arrivals, admitted or not
+    int completed_up;
+    int completed_down;
+    double mean_up_queue;
+    double mean_down_queue;
+    int max_up_queue;
+    int max_down_queue;
+    double occupancy;         // Share of the escalator's steps taken, all escalators
+} MallWindow;
+
+typedef void (*MallWindowFn)(void* user, const MallWindow* window);
+
+// Arrivals drawn once and shared by several malls (see mallsim_arrivals_create)
+typedef struct MallArrivals MallArrivals;
+
+/*
+ * Phase profile of mallsim_step: wall time spent in each phase of the tick and, where the
+ * kernel allows it, hardware counters (perf_event_open: cycles, instructions, cache misses
+ * in user space), summed over the ticks of every mall that points MallConfig.profile at
+ * it. Open it with mallsim_profile_open on the thread that steps those malls. A mall
+ * without a profile runs no profiling code at all.
+ */
+#define MALLSIM_PHASE_OPERATE    0   // Outages, waking agents, moving the escalator
+#define MALLSIM_PHASE_STATUS     1   // The tick's header and the two escalator status lines
+#define MALLSIM_PHASE_BOARD_UP   2
+#define MALLSIM_PHASE_BOARD_DOWN 3
+#define MALLSIM_PHASE_ARRIVALS   4   // People waiting outside and new arrivals
+#define MALLSIM_PHASE_MALL       5   // Counters, recorders, windows, the mall status line, the end of the run
+#define MALLSIM_PHASES           6
+
+#define MALLSIM_HW_CYCLES        0
+#define MALLSIM_HW_INSTRUCTIONS  1
+#define MALLSIM_HW_CACHE_MISSES  2
+#define MALLSIM_HW_COUNTERS      3
+
+typedef struct {
+    long ticks;
+    long ns[MALLSIM_PHASES];
+    long hw[MALLSIM_PHASES][MALLSIM_HW_COUNTERS];
+    int hardware;             // The counters are read (else only the times are kept)
+    int hw_error;             // errno of perf_event_open when they could not be opened
+    double clock_ns;          // One clock read, of which every phase of every tick has one
+    int counted;              // Bit e set for each MALLSIM_HW_* counter that opened (kept after closing)
+    int fd[MALLSIM_HW_COUNTERS];  // -1 for a counter the CPU or the kernel does not give
+    // Where the current phase started
+    long last_ns;
+    unsigned long long last_hw[MALLSIM_HW_COUNTERS];
+} MallProfile;
+
+typedef struct {
+    int escalator_steps;     // 1..MALLSIM_MAX_STEPS
+    int initial_customers;   // Present at time 0, random directions
+    int arrival_seconds;     // 0-2 more customers arrive every second before this time (sample7)
+    int arrival_max;         // Arrivals per second are uniform on 0..arrival_max (2), directions 50/50
+    int mall_capacity;       // Timed arrivals beyond this many people inside go to admission
+    int batch_size;          // Boardings in one direction before a waiting opposite queue gets the escalator (5)
+    int overflow_policy;     // MALLSIM_OVERFLOW_*
+    int holding_buffer;      // Places outside per direction for DEFER / SHED
+    int pair;                // Two one-way escalators instead of one reversible escalator
+    int wait_bound;          // Hard bound on the seconds a queue head waits at the front, 0 = off;
+                             // at least 2 * escalator_steps (one drain each way); not with
+                             // outages or breakdowns, which stop boarding for as long as they last
+
+    // Stand right / walk left: with 2 lanes, walkers take the left lane at their own speed
+    // and pass the standers on the right; each lane takes one boarding per tick
+    int lanes;               // 1 (single file, everybody stands) or 2
+    int walker_percent;      // Share of customers who walk (2 lanes only)
+    int walk_speed_max;      // Walkers cover 2..walk_speed_max steps per tick, escalator included (3)
+
+    // Outages: the escalator (both units of a pair) stops, riders stay where they are and
+    // nobody boards until it runs again; the queues keep growing meanwhile
+    int outage_start;        // Scheduled outage from this second...
+    int outage_length;       // ...for this many seconds, 0 = none
+    int breakdown_mtbf;      // Random breakdowns: mean running seconds between them, 0 = none
+    int breakdown_mttr;      // Mean seconds a breakdown takes to repair
+    unsigned int seed;
+
+    // Customer behaviour (agents): 0 disables the behaviour
+    int balk_length;         // Balk when the queue ahead is at least this long
+    int patience;            // Mean patience in seconds before leaving the queue
+    int stairs_time;         // Impatient customers take the stairs, arriving this many seconds later
+
+    // Priority classes: each direction keeps one queue per class, and the front of the line
+    // goes round the waiting classes, class_weight[k] customers of class k at a time
+    int classes;                             // 1..MALLSIM_MAX_CLASSES, 1 = a single queue
+    int class_percent[MALLSIM_MAX_CLASSES];  // Share of customers in class k >= 1; class 0 takes the rest
+    int class_weight[MALLSIM_MAX_CLASSES];   // Customers per round while class k waits (1)
+
+    // Flight recorder: the last flight_ticks ticks are always kept (see MallFlightRecord)
+    int flight_ticks;        // Ring size (64), 0 = no recorder
+    int flight_wait;         // Dump the ring once a queue head has waited this many seconds, 0 = never
+    MallLogFn flight_log;    // Receives each dump as one block of text (from any worker in a building)
+    void* flight_user;
+
+    // Per-customer records: a block is handed over whenever record_block rows are full, and
+    // the rest when the run ends (from any worker in a building, so the callback must lock)
+    MallRecordFn records;    // NULL = no records
+    void* records_user;
+    int record_block;        // Rows per block (1024)
+
+    MallTraceFn trace;       // Optional event trace, NULL = none (not used by buildings)
+    void* trace_user;
+
+    // Time series (see MallWindow), not used by buildings
+    MallWindowFn windows;    // NULL = none
+    void* windows_user;
+    int window;              // Seconds per window (60)
+
+    // Common random numbers: read the initial customers' directions and the timed arrivals
+    // from this stream instead of drawing them from seed; NULL = draw (not used by buildings)
+    const MallArrivals* arrival_stream;
+
+    MallProfile* profile;    // Phase profile (mallsim_profile_open), NULL = none (not used by buildings)
+
+    MallLogFn log;           // Optional per-tick log, NULL = silent
+    void* log_user;
+} MallConfig;
+
+/*
+ * Utilisation counters. Only the thread stepping the instance writes them, with relaxed
+ * atomic stores, so another thread may watch a running instance by reading them with
+ * MALLSIM_COUNTER_READ without any locking.
+ */
+typedef struct {
+    long ticks;
+    long boarded;
+    long completed;
+    long occupied_step_ticks;  // Sum over ticks of occupied steps, all escalators
+    long step_ticks;           // Sum over ticks of existing steps, all escalators
+    long idle_unit_ticks;      // Escalator-ticks with nobody aboard
+    long unit_ticks;
+    long idle_ticks;           // Ticks with nobody on any escalator of the mall
+    long direction_switches;
+    long drain_ticks;          // Ticks spent draining riders while the opposite queue waits
+    long outage_ticks;         // Ticks the escalator stood still because of an outage
+    int up_queue_length;       // Snapshot at the end of the last tick
+    int down_queue_length;
+    int on_escalator;
+    int peak_up_queue;
+    int peak_down_queue;
+} MallCounters;
+
+#define MALLSIM_COUNTER_READ(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+typedef struct {
+    int ticks;                // Ticks until the mall was empty (or simulated so far)
+    int completed;
+    int remaining;            // Customers still inside
+    int peak_customers;       // Most customers inside at the end of a tick (or at time 0)
+    long total_turnaround;
+    long total_wait;          // Sum of queue waits at boarding
+    unsigned long checksum;   // Order-sensitive hash of (id, turnaround) completions
+
+    int balked;               // Turned around on seeing the queue
+    int reneged;              // Gave up waiting and left
+    int rerouted;             // Gave up waiting and took the stairs instead
+    long agent_resumes;
+
+    int arrivals;             // Timed arrivals (initial customers are not counted)
+    int admitted;             // Entered the mall (directly or after waiting outside)
+    int deferred;             // Had to wait outside first
+    int rejected;             // Turned away by OVERFLOW_REJECT or a full buffer
+    int shed;                 // Dropped early by OVERFLOW_SHED
+    int still_outside;
+    long outside_wait;        // Total seconds spent outside by deferred customers who got in
+
+    int flight_dumps;         // Queue heads that reached MallConfig.flight_wait
+    int worst_head_queue_wait;  // Longest queue wait (since joining) of a customer at the head of a queue
+
+    int worst_front_wait;     // Longest time a customer spent at the front of a queue (see wait_bound)
+    int bound_holds;          // Boardings held back by the wait bound
+    int bound_switches;       // Phases the wait bound cut short
+
+    int walkers;              // Customers who walked up or down the left lane (2 lanes)
+
+    /*
+     * Outage episodes: from a stop until everybody queued through it has boarded and the
+     * queues are back within 10% of their level before it (a moving average of both queues'
+     * length), overlapping stops counting as one episode. Recovery is measured from the
+     * restart; an episode that began in the first minute, before there was a level, is
+     * counted as unmeasured instead.
+     */
+    int outages;              // Stops, scheduled and random
+    int outage_episodes;
+    int outage_recoveries;    // Episodes that recovered before the end of the run
+    int outage_unmeasured;    // Episodes that ended but began too early to measure
+    long outage_recovery_total;
+    int outage_recovery_worst;
+    int outage_peak_queue;    // Most people queued (both directions) during an episode
+    int outage_peak_wait;     // Longest queue wait of a boarding queued through a stop
+    long outage_wait;         // Queue waits of the boardings queued through a stop...
+    int outage_boardings;     // ...and how many there were
+
+    // Per priority class (the first cfg.classes entries); waits are counted per boarding
+    int class_customers[MALLSIM_MAX_CLASSES];
+    int class_boarded[MALLSIM_MAX_CLASSES];
+    long class_wait[MALLSIM_MAX_CLASSES];
+    int class_wait_max[MALLSIM_MAX_CLASSES];
+    int class_wait_hist[MALLSIM_MAX_CLASSES][MALLSIM_HIST_BUCKETS];  // Only with classes > 1 (else wait_hist)
+
+    MallCounters counters;
+    int wait_hist[MALLSIM_HIST_BUCKETS];        // Boardings per whole second of queue wait
+    int turnaround_hist[MALLSIM_HIST_BUCKETS];  // Completions per whole second of turnaround
+} MallResult;
+
+/*
+ * State at the end of one tick, as kept by the flight recorder. Queue heads are customer
+ * ids (0 = empty queue) with the seconds they have waited so far; the escalator fields
+ * describe the reversible escalator (the up unit of a pair, riders counting both units).
+ */
+typedef struct {
+    int time;
+    int up_length, down_length;
+    int up_head, up_head_wait;
+    int down_head, down_head_wait;
+    int direction;            // MALLSIM_UP / DOWN / IDLE
+    int on_escalator;
+    int boarded_count;        // Boardings in the current direction so far (batch progress)
+} MallFlightRecord;
+
+typedef struct MallSim MallSim;
+typedef struct MallBuilding MallBuilding;
+
+// Defaults: 13 steps, nobody inside, closed mall of capacity 30, batches of 5, reject, seed 1,
+// a single lane, a 64-tick flight recorder that never dumps, one-minute windows, silent
+void mallsim_default_config(MallConfig* cfg);
+
+// NULL if the configuration is valid, otherwise why not
+const char* mallsim_check_config(const MallConfig* cfg);
+
+// NULL if the configuration is invalid or memory runs out. The initial customers are
+// created immediately.
+MallSim* mallsim_create(const MallConfig* cfg);
+void mallsim_destroy(MallSim* sim);
+
+// Simulates one tick; returns 1 while the simulation continues, 0 once it has ended, -1 if
+// memory ran out (a new customer could not be created: only mallsim_destroy is left)
+int mallsim_step(MallSim* sim);
+
+// Current simulated second
+int mallsim_time(const MallSim* sim);
+
+// Live counters of a (possibly running) instance
+const MallCounters* mallsim_counters(const MallSim* sim);
+
+void mallsim_result(const MallSim* sim, MallResult* out);
+
+// Name of a MALLSIM_COL_* column ("id", "direction", ...)
+const char* mallsim_record_column(int col);
+
+// Copies up to max flight records, oldest first; returns how many were copied
+int mallsim_flight_records(const MallSim* sim, MallFlightRecord* out, int max);
+
+// create + step until the end + result + destroy; -1 if the configuration is invalid or
+// memory runs out
+int mallsim_run(const MallConfig* cfg, MallResult* out);
+
+/*
+ * Common random numbers: the arrivals of cfg (its initial customers' directions, then how
+ * many customers arrive each second until arrival_seconds and in which direction), drawn
+ * once from cfg->seed exactly as a mall would draw them. Malls given the stream in
+ * MallConfig.arrival_stream read their customers from it, so every variant of a policy
+ * sees the same ones. The stream is never written after it is created: any number of
+ * malls may read it at once, on any threads. Behaviours, walkers, classes and breakdowns
+ * still come from each mall's own seed. NULL if cfg is invalid or memory runs out.
+ */
+MallArrivals* mallsim_arrivals_create(const MallConfig* cfg);
+void mallsim_arrivals_destroy(MallArrivals* a);
+
+// Zeroes the profile and, with hardware set, opens the counters for the calling thread
+void mallsim_profile_open(MallProfile* p, int hardware);
+void mallsim_profile_close(MallProfile* p);
+
+// Names of the MALLSIM_PHASE_* and MALLSIM_HW_* indices
+const char* mallsim_phase_name(int phase);
+const char* mallsim_hw_counter_name(int counter);
+
+/*
+ * Reference engine (mallref.c): the control loop of the original sample7.c/sample8.c kept
+ * as it was written, for checking faster engines against by their event traces. It covers
+ * what those programs simulate: one reversible escalator, initial customers, timed arrivals
+ * turned away when the mall is full, and the batch rule; -1 for anything else, or if
+ * memory runs out. It draws its customers from rand() seeded with cfg->seed, like the
+ * programs did, so it is not reentrant. Only ticks, completed, remaining, the totals,
+ * checksum, arrivals, admitted and rejected are filled in.
+ */
+int mallsim_reference_run(const MallConfig* cfg, MallResult* out);
+
+/*
+ * A building of stacked escalators: escalator k links floor k and floor k+1. Every
+ * customer starts on a random floor and rides to another one, changing escalators on
+ * the way. Each escalator is a mall configured by cfg (arrivals, admission and logging
+ * are not used); the result is the same for any number of threads. NULL if the
+ * configuration is invalid or memory runs out.
+ */
+MallBuilding* mallsim_building_create(const MallConfig* cfg, int num_escalators, int customers_per_escalator);
+void mallsim_building_destroy(MallBuilding* b);
+
+// Runs the building until every customer has arrived; returns the number of threads used
+// (1 if no more threads could be created), -1 if memory runs out before it starts
+int mallsim_building_run(MallBuilding* b, int num_threads);
+
+const MallCounters* mallsim_building_counters(const MallBuilding* b, int escalator);
+
+// Totals over all escalators (counters are summed, peaks are the maximum); -1 if memory runs out
+int mallsim_building_result(const MallBuilding* b, MallResult* out);
+
+// Smallest value v such that at least p% of the histogram's samples are <= v
+int mallsim_percentile(const int* hist, double p);
+
+// Memory one waiting customer costs
+size_t mallsim_agent_size(void);
+
+/*
+ * Kernel microbenchmark: 'ticks' ticks of synthetic traffic on one escalator, moved by the
+ * stepping kernels (legacy = 0) or by the per-direction loops they replaced (legacy = 1).
+ * Returns a checksum that must not depend on 'legacy'; -1 for an invalid length.
+ */
+long mallsim_kernel_workload(int steps, long ticks, int legacy);
+
+/*
+ * Batch engine: many small closed malls (sample8.c runs: initial customers only, at most
+ * MALLSIM_BATCH_MAX_CUSTOMERS) simulated in lockstep, MALLSIM_BATCH_LANES instances per
+ * vector. An instance's escalator is a bitmask of occupied steps and its queues are
+ * counters; every tick advances all the instances of a vector with the same branch-free
+ * vector operations, whatever state each is in. Gives the same ticks, totals, checksum
+ * and direction switches as mallsim_run on each config; -1 (nothing run) if any config
+ * is not such a mall (arrivals, a pair, two lanes, classes, outages, behaviours, wait bound),
+ * -1 as well if memory runs out.
+ */
+#define MALLSIM_BATCH_LANES         4    // 32-bit lanes of a 128-bit vector, which every x86-64 has
+#define MALLSIM_BATCH_MAX_CUSTOMERS 64
+
+typedef struct {
+    int ticks;
+    int completed;
+    long total_turnaround;
+    long total_wait;
+    unsigned long checksum;
+    long direction_switches;
+} MallBatchResult;
+
+int mallsim_batch_run(const MallConfig* cfgs, int n, MallBatchResult* out);
+
+// Two-sided 95% Student t quantile for df degrees of freedom (confidence intervals)
+double mallsim_t95(int df);
+
+// Mean of v[0..n-1] and the half-width of its 95% t-interval (INFINITY below 2 values)
+void mallsim_mean_halfwidth(const double* v, int n, double* mean, double* half);
+
+/*
+ * Capacity planning (mallplan.c): finds the cheapest configuration whose wait p99 meets a
+ * target on the arrival profile of a base config. Cost is the escalator length; among
+ * configurations of the cheapest length that qualify, the largest mall capacity wins,
+ * then the lowest p99. Every candidate is simulated on the same seeds (base seed, +1, ...)
+ * in rounds of replications spread over worker threads; a candidate is pruned as soon as
+ * its 95% interval lies entirely above the target, and accepted once it lies entirely below.
+ */
+typedef struct {
+    int steps_min, steps_max;
+    int capacity_min, capacity_max, capacity_step;  // Only searched for an open mall (arrivals)
+    int batch_min, batch_max;
+    double target_p99;        // Seconds of queue wait
+    double max_loss;          // Largest acceptable fraction of arrivals rejected or shed
+    int replications;         // At most this many runs per candidate
+    int round;                // Replications per candidate between pruning decisions (>= 2)
+    int threads;
+} MallPlanSpec;
+
+typedef struct {
+    int found;
+    MallConfig best;          // Base config with the chosen steps, capacity and batch size
+    int replications;         // Runs behind the estimates below
+    double p99_mean, p99_low, p99_high;     // 95% intervals, clipped to what is possible:
+    double loss_mean, loss_low, loss_high;  // p99 >= 0, 0 <= loss <= 1
+    int levels;               // Escalator lengths searched
+    int candidates;
+    int pruned;               // Dropped before their last replication
+    long runs;                // Simulations in total
+} MallPlanResult;
+
+// Defaults: 1..13 steps, capacity 10..60 by 5, batches 1..10, p99 <= 60 s, loss <= 5%, 32 runs in rounds of 4
+void mallsim_default_plan(MallPlanSpec* spec);
+
+// -1 if the base configuration or the search space is invalid, or memory runs out
+int mallsim_plan(const MallConfig* base, const MallPlanSpec* spec, MallPlanResult* out);
+
+/*
+ * Stopping rules (mallstop.c): the mean queue wait and turnaround of the customers who rode,
+ * with 95% intervals, simulating only until both half-widths are within a fraction
+ * (precision) of their means.
+ *
+ * mallsim_replicate runs replications on the seeds base seed, +1, ... in rounds spread over
+ * worker threads. For an open mall the empty-start transient is cut first: the waits are
+ * pooled per arrival bin over the replications so far (Welch), MSER picks the cut, and each
+ * replication counts only the customers who arrived after it. A closed mall's drain is
+ * all transient and is taken whole.
+ *
+ * mallsim_steady_run makes one long run of an open mall instead, up to arrival_seconds:
+ * MSER-5 cuts the warm-up from the customers in the order they finished, and the rest is
+ * split into batch means. It stops as soon as the intervals are narrow enough.
+ */
+typedef struct {
+    double precision;         // Target half-width as a fraction of the mean (0.05)
+    int min_replications;     // Before the first verdict (10)
+    int replications;         // At most (1000)
+    int round;                // Replications between verdicts (4)
+    int batches;              // Batch means of a long run (20)
+    int check;                // Fewest customers between verdicts of a long run (1000)
+    int threads;
+} MallStopSpec;
+
+typedef struct {
+    int estimated;            // There was enough data for an interval
+    int converged;            // Both intervals reached the precision
+    int runs;                 // Replications (1 for a long run)
+    long ticks;               // Seconds simulated, all runs
+    int warmup;               // Seconds cut as warm-up
+    long discarded;           // Customers cut with it
+    long observations;        // Customers behind the estimates
+    int batches;              // Replications or batch means behind the intervals
+    double wait_mean, wait_half;
+    double turnaround_mean, turnaround_half;
+} MallStopResult;
+
+// Defaults: 5%, 10..1000 replications in rounds of 4, 20 batches, a verdict every 1000+ customers
+void mallsim_default_stop(MallStopSpec* spec);
+
+// -1 if the configuration or the spec is invalid, or memory runs out
+int mallsim_replicate(const MallConfig* base, const MallStopSpec* spec, MallStopResult* out);
+
+// -1 if the configuration or the spec is invalid, the mall is closed, or memory runs out
+int mallsim_steady_run(const MallConfig* base, const MallStopSpec* spec, MallStopResult* out);
+
+/*
+ * Policy comparison (mallcompare.c): variants of one mall, say different batch sizes, each
+ * run on replications r = 0, 1, ... With common random numbers, replication r of every
+ * variant uses seed + r: its arrival stream is drawn once and shared by the variants that
+ * run it at the same time, and each variant is compared with variant 0 on the differences
+ * within each replication (paired). Without, variant v runs seeds of its own and the
+ * difference of the means carries the variance of both.
+ */
+typedef struct {
+    int replications;         // Runs per variant (32)
+    int common;               // 1 = common random numbers, 0 = independent seeds per variant
+    int threads;
+} MallCompareSpec;
+
+typedef struct {
+    double wait_mean, wait_half;               // Mean queue wait per boarding, 95% interval
+    double turnaround_mean, turnaround_half;
+    double wait_diff, wait_diff_half;          // This variant minus variant 0
+    double turnaround_diff, turnaround_diff_half;
+} MallVariantResult;
+
+// Defaults: 32 replications, common random numbers, 1 thread
+void mallsim_default_compare(MallCompareSpec* spec);
+
+// -1 if a variant is invalid, the variants differ in seed, initial customers or arrivals,
+// or memory runs out
+int mallsim_compare(const MallConfig* variants, int num_variants, const MallCompareSpec* spec, MallVariantResult* out);
+
+/*
+ * Analytic estimate (mallmodel.c): closed-form / fixed-point approximation of the
+ * reversible escalator under the batch-switching policy, for sweeping parameters far
+ * faster than simulating. An open mall (arrivals) gets steady-state rates for the
+ * arrivals' uniform 0..arrival_max per second split evenly between directions; a closed
+ * mall gets its drain, with the initial customers split evenly. Customer behaviours are
+ * ignored. How far it is from the simulator is measured by `project2 --estimate-bench`.
+ */
+#define MALLSIM_REGIME_CLOSED    0   // No arrivals: the initial customers drain
+#define MALLSIM_REGIME_STABLE    1   // Every arrival is served, batches may stay below batch_size
+#define MALLSIM_REGIME_SATURATED 2   // Full batches both ways cannot keep up; the mall stays full
+
+typedef struct {
+    int regime;
+    double throughput;        // Riders per second
+    double mean_wait;         // Seconds from arrival to boarding
+    double mean_turnaround;
+    double switch_rate;       // Direction switches per second
+    double cycle;             // Seconds for an up and a down phase (open mall)
+    double batch;             // Mean boardings per phase (open mall)
+    double loss;              // Share of arrivals turned away or shed (saturated)
+    double makespan;          // Seconds until the mall is empty (closed mall)
+} MallEstimate;
+
+// -1 if the configuration is invalid, a one-way pair (nothing to switch), two lanes, or uses
+// balking, patience, priority classes, outages, breakdowns or a wait bound
+int mallsim_estimate(const MallConfig* cfg, MallEstimate* out);
+
+#endif
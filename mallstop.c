@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "mallsim.h"
+
+/*
+ * Output analysis: how much of a run to throw away and when to stop simulating.
+ *
+ * Both estimators look at the customers who rode (MallConfig.records), their queue wait
+ * and their turnaround. The warm-up is found by MSER (marginal standard error rule): for
+ * a series of means Z_1..Z_m, cut the first d where sum((Z_i - mean)^2) / (m - d)^2 over
+ * what remains is smallest; a minimum in the second half of the series means it has not
+ * settled yet.
+ */
+
+#define STOP_MSER_BATCH 5     // Customers per point of a long run's MSER series (MSER-5)
+#define STOP_BINS       256   // Most arrival bins per replication of an open mall
+#define STOP_BIN_MIN    5     // Shortest arrival bin, in seconds
+#define STOP_MIN_BATCH  10    // Fewest customers per batch mean
+#define STOP_MSER_TAIL  5     // Points MSER always keeps (its score is noise over fewer)
+#define STOP_MAX_LAG1   0.2   // Batch means more correlated than this are too short to trust
+
+void mallsim_default_stop(MallStopSpec* spec){
+    memset(spec, 0, sizeof(*spec));
+    spec->precision = 0.05;
+    spec->min_replications = 10;
+    spec->replications = 1000;
+    spec->round = 4;
+    spec->batches = 20;
+    spec->check = 1000;
+    spec->threads = 1;
+}
+
+static int check_spec(const MallConfig* base, const MallStopSpec* spec){
+    return mallsim_check_config(base) == NULL && spec->precision > 0 &&
+           spec->min_replications >= 2 && spec->replications >= spec->min_replications &&
+           spec->round >= 1 && spec->batches >= 2 && spec->check >= 1 && spec->threads >= 1;
+}
+
+// Points to cut from z[0..m-1], -1 if the series has not settled
+static int mser_cut(const double* z, int m){
+    if(m < 2 * STOP_MSER_TAIL) return -1;
+    double sum = 0.0, sq = 0.0;
+    for(int i=0; i<m; i++){
+        sum += z[i];
+        sq += z[i] * z[i];
+    }
+    // Walk d upwards, removing z[d-1] from the running sums
+    int best = 0;
+    double best_score = INFINITY;
+    for(int d=0; d<=m-STOP_MSER_TAIL; d++){
+        if(d > 0){
+            sum -= z[d-1];
+            sq -= z[d-1] * z[d-1];
+        }
+        double n = m - d;
+        double score = (sq - sum * sum / n) / (n * n);
+        if(score < best_score){
+            best_score = score;
+            best = d;
+        }
+    }
+    return (best < m/2) ? best : -1;
+}
+
+static int precise(double mean, double half, double precision){
+    return half <= precision * fabs(mean);
+}
+
+// --------------------------------------------------
+// Independent replications
+// --------------------------------------------------
+
+// What one replication leaves behind: wait and turnaround sums per arrival bin
+typedef struct {
+    double* wait;
+    double* turnaround;
+    long* count;
+    int bin;          // Seconds per bin
+    int ticks;
+} RepBins;
+
+typedef struct {
+    const MallConfig* base;
+    RepBins* reps;
+    int first, last;  // Replications of this round
+    int next;         // Next one, taken with an atomic increment
+    int failed;       // Memory ran out in a run or a worker
+} StopRound;
+
+static void bin_records(void* user, const MallRecordBlock* block){
+    RepBins* rb = (RepBins*)user;
+    for(int i=0; i<block->rows; i++){
+        if(block->column[MALLSIM_COL_OUTCOME][i] != MALLSIM_OUTCOME_RODE) continue;
+        int arrival = block->column[MALLSIM_COL_ARRIVAL][i];
+        int b = arrival / rb->bin;
+        rb->wait[b] += block->column[MALLSIM_COL_WAIT][i];
+        rb->turnaround[b] += block->column[MALLSIM_COL_FINISH][i] - arrival;
+        rb->count[b]++;
+    }
+}
+
+static void* stop_worker(void* arg){
+    StopRound* sr = (StopRound*)arg;
+    MallResult* r = (MallResult*)malloc(sizeof(MallResult));
+    if(!r){
+        __atomic_store_n(&sr->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    int rep;
+    while((rep = sr->first + __atomic_fetch_add(&sr->next, 1, __ATOMIC_RELAXED)) < sr->last){
+        MallConfig cfg = *sr->base;
+        cfg.seed = sr->base->seed + (unsigned int)rep;
+        cfg.records = bin_records;
+        cfg.records_user = &sr->reps[rep];
+        if(mallsim_run(&cfg, r) != 0){
+            __atomic_store_n(&sr->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        sr->reps[rep].ticks = r->ticks;
+    }
+    free(r);
+    return NULL;
+}
+
+// With fewer threads than asked for (none at all, even), the calling thread takes the rest
+static void run_replications(StopRound* sr, int threads){
+    sr->next = 0;
+    if(threads > sr->last - sr->first) threads = sr->last - sr->first;
+    pthread_t* tids = (threads > 1) ? (pthread_t*)malloc(sizeof(pthread_t) * threads) : NULL;
+    int started = 0;
+    while(tids && started < threads && pthread_create(&tids[started], NULL, stop_worker, sr) == 0){
+        started++;
+    }
+    if(started == 0) stop_worker(sr);
+    for(int t=0; t<started; t++){
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+}
+
+/*
+ * Welch's procedure: the MSER series is the wait per arrival bin pooled over every
+ * replication so far, so the cut moves as replications come in and each replication is
+ * judged again on the customers who arrived after it.
+ */
+static int welch_cut(const RepBins* reps, int done, int num_bins, double* z, int* bin_of){
+    int m = 0;
+    for(int b=0; b<num_bins; b++){
+        double wait = 0.0;
+        long count = 0;
+        for(int r=0; r<done; r++){
+            wait += reps[r].wait[b];
+            count += reps[r].count[b];
+        }
+        if(count == 0) continue;
+        z[m] = wait / count;
+        bin_of[m++] = b;
+    }
+    int d = mser_cut(z, m);
+    return (d < 0) ? -1 : bin_of[d];
+}
+
+int mallsim_replicate(const MallConfig* base, const MallStopSpec* spec, MallStopResult* out){
+    memset(out, 0, sizeof(*out));
+    if(!check_spec(base, spec)) return -1;
+
+    MallConfig cfg = *base;
+    cfg.log = NULL;
+    cfg.flight_log = NULL;
+    cfg.trace = NULL;
+    cfg.windows = NULL;
+    cfg.arrival_stream = NULL;   // Every replication draws its own
+    cfg.profile = NULL;          // Replications run on worker threads
+    int open = base->arrival_seconds > 0;
+    int bin = open ? (base->arrival_seconds + STOP_BINS - 1) / STOP_BINS : 1;
+    if(open && bin < STOP_BIN_MIN) bin = STOP_BIN_MIN;
+    int num_bins = open ? (base->arrival_seconds - 1) / bin + 1 : 1;
+
+    RepBins* reps = (RepBins*)calloc(spec->replications, sizeof(RepBins));
+    double* sums = (double*)calloc((size_t)2 * spec->replications * num_bins, sizeof(double));
+    long* counts = (long*)calloc((size_t)spec->replications * num_bins, sizeof(long));
+    double* z = (double*)malloc(sizeof(double) * num_bins);
+    int* bin_of = (int*)malloc(sizeof(int) * num_bins);
+    double* wait = (double*)malloc(sizeof(double) * spec->replications);
+    double* turnaround = (double*)malloc(sizeof(double) * spec->replications);
+    int failed = !reps || !sums || !counts || !z || !bin_of || !wait || !turnaround;
+    for(int r=0; !failed && r<spec->replications; r++){
+        reps[r].wait = sums + (size_t)2 * r * num_bins;
+        reps[r].turnaround = reps[r].wait + num_bins;
+        reps[r].count = counts + (size_t)r * num_bins;
+        reps[r].bin = bin;
+    }
+
+    StopRound sr;
+    sr.base = &cfg;
+    sr.reps = reps;
+    sr.failed = 0;
+    int done = 0;
+    while(!failed && done < spec->replications && !out->converged){
+        sr.first = done;
+        sr.last = done + spec->round;
+        if(sr.last < spec->min_replications) sr.last = spec->min_replications;
+        if(sr.last > spec->replications) sr.last = spec->replications;
+        run_replications(&sr, spec->threads);
+        if(sr.failed){
+            failed = 1;
+            break;
+        }
+        for(int r=done; r<sr.last; r++) out->ticks += reps[r].ticks;
+        done = sr.last;
+
+        // A closed mall drains once: all of it is the answer, nothing to cut
+        int cut = open ? welch_cut(reps, done, num_bins, z, bin_of) : 0;
+        if(cut < 0) continue;
+        int n = 0;
+        long kept = 0, cut_away = 0;
+        for(int r=0; r<done; r++){
+            double w = 0.0, t = 0.0;
+            long c = 0;
+            for(int b=0; b<num_bins; b++){
+                if(b < cut){
+                    cut_away += reps[r].count[b];
+                    continue;
+                }
+                w += reps[r].wait[b];
+                t += reps[r].turnaround[b];
+                c += reps[r].count[b];
+            }
+            if(c == 0) continue;
+            wait[n] = w / c;
+            turnaround[n++] = t / c;
+            kept += c;
+        }
+        if(n < 2) continue;
+        mallsim_mean_halfwidth(wait, n, &out->wait_mean, &out->wait_half);
+        mallsim_mean_halfwidth(turnaround, n, &out->turnaround_mean, &out->turnaround_half);
+        out->estimated = 1;
+        out->warmup = cut * bin;
+        out->discarded = cut_away;
+        out->observations = kept;
+        out->batches = n;
+        out->converged = precise(out->wait_mean, out->wait_half, spec->precision) &&
+                         precise(out->turnaround_mean, out->turnaround_half, spec->precision);
+    }
+    out->runs = done;
+
+    free(turnaround);
+    free(wait);
+    free(bin_of);
+    free(z);
+    free(counts);
+    free(sums);
+    free(reps);
+    if(failed){
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+    return 0;
+}
+
+// --------------------------------------------------
+// One long run, batch means
+// --------------------------------------------------
+
+typedef struct {
+    int* wait;        // Per customer who rode, in the order they finished
+    int* turnaround;
+    int* finish;
+    long count;
+    long capacity;
+    int closed;       // Verdict reached: ignore the rows flushed while shutting down
+    int failed;       // Memory ran out while growing the series
+} RunSeries;
+
+static void series_records(void* user, const MallRecordBlock* block){
+    RunSeries* s = (RunSeries*)user;
+    if(s->closed) return;
+    for(int i=0; i<block->rows; i++){
+        if(block->column[MALLSIM_COL_OUTCOME][i] != MALLSIM_OUTCOME_RODE) continue;
+        if(s->count == s->capacity){
+            long capacity = s->capacity ? 2 * s->capacity : 4096;
+            int* wait = (int*)realloc(s->wait, sizeof(int) * capacity);
+            if(wait) s->wait = wait;
+            int* turnaround = (int*)realloc(s->turnaround, sizeof(int) * capacity);
+            if(turnaround) s->turnaround = turnaround;
+            int* finish = (int*)realloc(s->finish, sizeof(int) * capacity);
+            if(finish) s->finish = finish;
+            if(!wait || !turnaround || !finish){
+                s->failed = 1;
+                s->closed = 1;
+                return;
+            }
+            s->capacity = capacity;
+        }
+        int finish = block->column[MALLSIM_COL_FINISH][i];
+        s->wait[s->count] = block->column[MALLSIM_COL_WAIT][i];
+        s->turnaround[s->count] = finish - block->column[MALLSIM_COL_ARRIVAL][i];
+        s->finish[s->count++] = finish;
+    }
+}
+
+// MSER-5 on one column: customers to cut, -1 if it has not settled
+static long series_cut(const int* v, long n, double* z){
+    int m = (int)(n / STOP_MSER_BATCH);
+    for(int i=0; i<m; i++){
+        long sum = 0;
+        for(int j=0; j<STOP_MSER_BATCH; j++) sum += v[(long)i * STOP_MSER_BATCH + j];
+        z[i] = (double)sum / STOP_MSER_BATCH;
+    }
+    int d = mser_cut(z, m);
+    return (d < 0) ? -1 : (long)d * STOP_MSER_BATCH;
+}
+
+// Returns the lag-1 autocorrelation of the batch means
+static double batch_means(const int* v, long first, long size, int batches, double* means, double* mean, double* half){
+    for(int k=0; k<batches; k++){
+        long sum = 0;
+        for(long j=0; j<size; j++) sum += v[first + k * size + j];
+        means[k] = (double)sum / size;
+    }
+    mallsim_mean_halfwidth(means, batches, mean, half);
+    double var = 0.0, cov = 0.0;
+    for(int k=0; k<batches; k++){
+        var += (means[k] - *mean) * (means[k] - *mean);
+        if(k > 0) cov += (means[k] - *mean) * (means[k-1] - *mean);
+    }
+    return (var > 0) ? cov / var : 0.0;
+}
+
+// Cuts the warm-up and estimates from what is left; 0 if there is not enough of it yet
+static int judge_series(const RunSeries* s, const MallStopSpec* spec, double* z, double* means, MallStopResult* out){
+    long cut_wait = series_cut(s->wait, s->count, z);
+    long cut_turnaround = series_cut(s->turnaround, s->count, z);
+    if(cut_wait < 0 || cut_turnaround < 0) return 0;
+    long cut = (cut_wait > cut_turnaround) ? cut_wait : cut_turnaround;
+    long size = (s->count - cut) / spec->batches;
+    if(size < STOP_MIN_BATCH) return 0;
+    double lag_wait = batch_means(s->wait, cut, size, spec->batches, means, &out->wait_mean, &out->wait_half);
+    double lag_turnaround = batch_means(s->turnaround, cut, size, spec->batches, means,
+                                        &out->turnaround_mean, &out->turnaround_half);
+    out->estimated = 1;
+    out->warmup = cut ? s->finish[cut-1] : 0;
+    out->discarded = cut;
+    out->observations = size * spec->batches;
+    out->batches = spec->batches;
+    // Correlated batches make the intervals too narrow: wait for longer ones
+    out->converged = lag_wait <= STOP_MAX_LAG1 && lag_turnaround <= STOP_MAX_LAG1 &&
+                     precise(out->wait_mean, out->wait_half, spec->precision) &&
+                     precise(out->turnaround_mean, out->turnaround_half, spec->precision);
+    return 1;
+}
+
+int mallsim_steady_run(const MallConfig* base, const MallStopSpec* spec, MallStopResult* out){
+    memset(out, 0, sizeof(*out));
+    if(!check_spec(base, spec) || base->arrival_seconds == 0) return -1;
+
+    RunSeries s;
+    memset(&s, 0, sizeof(s));
+    MallConfig cfg = *base;
+    cfg.log = NULL;
+    cfg.flight_log = NULL;
+    cfg.trace = NULL;
+    cfg.windows = NULL;
+    cfg.records = series_records;
+    cfg.records_user = &s;
+
+    double* z = NULL;
+    double* means = (double*)malloc(sizeof(double) * spec->batches);
+    MallSim* sim = means ? mallsim_create(&cfg) : NULL;
+    int failed = !sim;
+    // Stops with the arrivals at the latest: the drain after them is another transient.
+    // The checks get further apart as the series grows, so the run stays linear.
+    long next_check = spec->check;
+    while(!failed && !out->converged && mallsim_time(sim) < base->arrival_seconds){
+        if(mallsim_step(sim) < 0 || s.failed){
+            failed = 1;
+            break;
+        }
+        if(s.count < next_check && mallsim_time(sim) < base->arrival_seconds) continue;
+        double* grown = (double*)realloc(z, sizeof(double) * (s.count / STOP_MSER_BATCH + 1));
+        if(!grown){
+            failed = 1;
+            break;
+        }
+        z = grown;
+        judge_series(&s, spec, z, means, out);
+        next_check = s.count + (s.count / 4 > spec->check ? s.count / 4 : spec->check);
+    }
+    if(sim){
+        out->ticks = mallsim_time(sim);
+        out->runs = 1;
+        s.closed = 1;
+        mallsim_destroy(sim);
+    }
+
+    free(means);
+    free(z);
+    free(s.wait);
+    free(s.turnaround);
+    free(s.finish);
+    if(failed){
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "metrics.h"
+
+// One metric, one sample per mall (labelled by escalator index when there are several)
+static void write_metric(FILE* f, MetricsPublisher* p, const char* name, const char* type,
+                         const char* help, size_t offset, int is_long, const char* extra_label){
+    if(help){
+        fprintf(f, "# HELP %s %s\n", name, help);
+        fprintf(f, "# TYPE %s %s\n", name, type);
+    }
+    for(int i=0; i<p->num_malls; i++){
+        const char* base = (const char*)p->counters[i] + offset;
+        long v = is_long ? MALLSIM_COUNTER_READ(*(const long*)base) : (long)MALLSIM_COUNTER_READ(*(const int*)base);
+        char labels[96] = "";
+        if(p->num_malls > 1 && extra_label){
+            snprintf(labels, sizeof(labels), "{escalator=\"%d\",%s}", i, extra_label);
+        } else if(p->num_malls > 1){
+            snprintf(labels, sizeof(labels), "{escalator=\"%d\"}", i);
+        } else if(extra_label){
+            snprintf(labels, sizeof(labels), "{%s}", extra_label);
+        }
+        fprintf(f, "%s%s %ld\n", name, labels, v);
+    }
+}
+
+#define METRIC_LONG(name, type, help, field) \
+    write_metric(f, p, name, type, help, offsetof(MallCounters, field), 1, NULL)
+#define METRIC_INT(name, type, help, field, label) \
+    write_metric(f, p, name, type, help, offsetof(MallCounters, field), 0, label)
+
+/*
+ * Writes the exposition to <path>.tmp and renames it over <path>, so a scraper never
+ * sees a half-written file. Ratios are left to the scraper (occupied / available).
+ */
+static int write_metrics_file(MetricsPublisher* p){
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", p->path);
+    FILE* f = fopen(tmp, "w");
+    if(!f){
+        perror("metrics file");
+        return -1;
+    }
+    METRIC_LONG("mall_ticks_total", "counter", "Simulated seconds elapsed.", ticks);
+    METRIC_LONG("mall_boarded_total", "counter", "Customers that boarded an escalator.", boarded);
+    METRIC_LONG("mall_completed_total", "counter", "Customers that finished their trip.", completed);
+    METRIC_LONG("mall_occupied_step_ticks_total", "counter", "Sum over ticks of occupied escalator steps.", occupied_step_ticks);
+    METRIC_LONG("mall_step_ticks_total", "counter", "Sum over ticks of available escalator steps.", step_ticks);
+    METRIC_LONG("mall_idle_ticks_total", "counter", "Ticks with nobody on any escalator.", idle_ticks);
+    METRIC_LONG("mall_direction_switches_total", "counter", "Times the reversible escalator changed direction.", direction_switches);
+    METRIC_LONG("mall_drain_ticks_total", "counter", "Ticks spent draining riders while the opposite queue waited.", drain_ticks);
+    METRIC_LONG("mall_outage_ticks_total", "counter", "Ticks the escalator stood still because of an outage.", outage_ticks);
+    METRIC_INT("mall_queue_length", "gauge", "Queue length at the end of the last tick.", up_queue_length, "direction=\"up\"");
+    METRIC_INT("mall_queue_length", "gauge", NULL, down_queue_length, "direction=\"down\"");
+    METRIC_INT("mall_queue_peak_length", "gauge", "Longest the queue has been.", peak_up_queue, "direction=\"up\"");
+    METRIC_INT("mall_queue_peak_length", "gauge", NULL, peak_down_queue, "direction=\"down\"");
+    METRIC_INT("mall_on_escalator", "gauge", "Riders on the escalator(s) at the end of the last tick.", on_escalator, NULL);
+    if(fclose(f) != 0 || rename(tmp, p->path) != 0){
+        perror("metrics file");
+        return -1;
+    }
+    return 0;
+}
+
+static void* metrics_publisher_thread(void* arg){
+    MetricsPublisher* p = (MetricsPublisher*)arg;
+    pthread_mutex_lock(&p->lock);
+    while(!p->stop){
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += p->interval_ms / 1000;
+        deadline.tv_nsec += (long)(p->interval_ms % 1000) * 1000000L;
+        if(deadline.tv_nsec >= 1000000000L){
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&p->wake, &p->lock, &deadline);
+        write_metrics_file(p);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+MetricsPublisher* start_metrics_publisher(const char* path, int interval_ms,
+                                          const MallCounters** counters, int num_malls){
+    MetricsPublisher* p = (MetricsPublisher*)malloc(sizeof(MetricsPublisher));
+    if(!p){
+        perror("malloc metrics publisher");
+        exit(EXIT_FAILURE);
+    }
+    p->path = path;
+    p->interval_ms = (interval_ms > 0) ? interval_ms : 1000;
+    p->counters = counters;
+    p->num_malls = num_malls;
+    p->stop = 0;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    write_metrics_file(p);
+    if(pthread_create(&p->thread, NULL, metrics_publisher_thread, p) != 0){
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+// Stops the publisher; the file is rewritten once more with the final values
+void stop_metrics_publisher(MetricsPublisher* p){
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
@@ -0,0 +1,25 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+
+#include "mallsim.h"
+
+// Periodically rewrites a text exposition of the counters of one or more malls
+typedef struct {
+    const char* path;
+    int interval_ms;
+    const MallCounters** counters;
+    int num_malls;
+    pthread_t thread;
+    pthread_mutex_t lock;     // Only for the stop handshake, never taken by the simulation
+    pthread_cond_t wake;
+    int stop;
+} MetricsPublisher;
+
+// 'counters' must stay valid until the publisher is stopped
+MetricsPublisher* start_metrics_publisher(const char* path, int interval_ms,
+                                          const MallCounters** counters, int num_malls);
+void stop_metrics_publisher(MetricsPublisher* p);
+
+#endif
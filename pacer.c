@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pacer.h"
+
+/*
+ * Tick n is released at start + n * tick_ms on CLOCK_MONOTONIC (clock_nanosleep with
+ * TIMER_ABSTIME), so the work done inside an iteration no longer adds to the period and
+ * simulated time cannot drift behind the wall clock. A tick whose work ends after its
+ * deadline is an overrun: the next one starts immediately and the schedule catches up.
+ * Jitter is how late we actually woke up relative to the deadline.
+ */
+void pacer_start(Pacer* p, int tick_ms){
+    memset(p, 0, sizeof(*p));
+    p->tick_ms = tick_ms;
+    clock_gettime(CLOCK_MONOTONIC, &p->start);
+}
+
+static long timespec_diff_us(const struct timespec* a, const struct timespec* b){
+    return (a->tv_sec - b->tv_sec) * 1000000L + (a->tv_nsec - b->tv_nsec) / 1000L;
+}
+
+void pacer_wait(Pacer* p){
+    if(p->tick_ms <= 0) return;
+    p->ticks++;
+    long long offset_ns = (long long)p->ticks * p->tick_ms * 1000000LL;
+    struct timespec deadline = p->start;
+    deadline.tv_sec  += offset_ns / 1000000000LL;
+    deadline.tv_nsec += offset_ns % 1000000000LL;
+    if(deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(timespec_diff_us(&now, &deadline) > 0){
+        p->overruns++;
+    } else {
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0) { }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+
+    long late_us = timespec_diff_us(&now, &deadline);
+    if(late_us < 0) late_us = 0;
+    p->sum_late_us += late_us;
+    if(late_us > p->max_late_us) p->max_late_us = late_us;
+    long bucket = late_us / PACER_BUCKET_US;
+    p->late_hist[(bucket < PACER_BUCKETS) ? bucket : PACER_BUCKETS-1]++;
+}
+
+static double pacer_percentile_ms(const Pacer* p, double pct){
+    long rank = (long)(pct / 100.0 * p->ticks + 0.999999);
+    long seen = 0;
+    for(int i=0; i<PACER_BUCKETS; i++){
+        seen += p->late_hist[i];
+        if(seen >= rank) return (i + 1) * PACER_BUCKET_US / 1000.0;
+    }
+    return PACER_BUCKETS * PACER_BUCKET_US / 1000.0;
+}
+
+void pacer_report(const Pacer* p){
+    if(p->tick_ms <= 0 || p->ticks == 0) return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("Pacing: tick = %d ms, ticks = %ld, overruns = %ld, drift = %.3f ms\n",
+           p->tick_ms, p->ticks, p->overruns,
+           timespec_diff_us(&now, &p->start) / 1000.0 - (double)p->ticks * p->tick_ms);
+    printf("Tick jitter: mean = %.3f ms, p50 <= %.2f ms, p99 <= %.2f ms, max = %.3f ms\n",
+           (double)p->sum_late_us / p->ticks / 1000.0,
+           pacer_percentile_ms(p, 50), pacer_percentile_ms(p, 99),
+           p->max_late_us / 1000.0);
+}
@@ -0,0 +1,23 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <time.h>
+
+// Wall-clock pacing of a control loop (absolute deadlines, see pacer_wait)
+#define PACER_BUCKET_US 10     // Jitter histogram resolution
+#define PACER_BUCKETS   5000   // Lateness of 50 ms or more shares the last bucket
+typedef struct {
+    int tick_ms;               // 0 => no pacing, run as fast as possible
+    struct timespec start;
+    long ticks;
+    long overruns;             // Ticks whose work ended after their deadline
+    long sum_late_us;
+    long max_late_us;
+    int late_hist[PACER_BUCKETS];
+} Pacer;
+
+void pacer_start(Pacer* p, int tick_ms);
+void pacer_wait(Pacer* p);
+void pacer_report(const Pacer* p);
+
+#endif
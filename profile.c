@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "profile.h"
+
+void print_profile(const MallProfile* p){
+    long total_ns = 0;
+    long total_hw[MALLSIM_HW_COUNTERS] = { 0, 0, 0 };
+    for(int ph=0; ph<MALLSIM_PHASES; ph++){
+        total_ns += p->ns[ph];
+        for(int e=0; e<MALLSIM_HW_COUNTERS; e++) total_hw[e] += p->hw[ph][e];
+    }
+    double ticks = p->ticks ? (double)p->ticks : 1.0;
+
+    printf("\n===== Phase Profile (%ld ticks) =====\n", p->ticks);
+    printf("%-12s %10s %7s", "Phase", "ns/tick", "share");
+    if(p->hardware){
+        for(int e=0; e<MALLSIM_HW_COUNTERS; e++){
+            if(p->counted & (1 << e)) printf(" %14s", mallsim_hw_counter_name(e));
+        }
+        if(p->counted & (1 << MALLSIM_HW_INSTRUCTIONS)) printf(" %6s", "IPC");
+    }
+    printf("\n");
+    for(int ph=0; ph<=MALLSIM_PHASES; ph++){
+        // The last row is the whole tick
+        long ns = (ph < MALLSIM_PHASES) ? p->ns[ph] : total_ns;
+        const long* hw = (ph < MALLSIM_PHASES) ? p->hw[ph] : total_hw;
+        printf("%-12s %10.1f %6.1f%%", (ph < MALLSIM_PHASES) ? mallsim_phase_name(ph) : "total",
+               ns / ticks, total_ns ? 100.0 * ns / total_ns : 0.0);
+        if(p->hardware){
+            for(int e=0; e<MALLSIM_HW_COUNTERS; e++){
+                if(p->counted & (1 << e)) printf(" %14.1f", hw[e] / ticks);
+            }
+            if(p->counted & (1 << MALLSIM_HW_INSTRUCTIONS)){
+                printf(" %6.2f", hw[MALLSIM_HW_CYCLES] ? (double)hw[MALLSIM_HW_INSTRUCTIONS] / hw[MALLSIM_HW_CYCLES] : 0.0);
+            }
+        }
+        printf("\n");
+    }
+    printf("Each figure includes a clock read of about %.0f ns per lap (three laps for status, one for the rest)\n",
+           p->clock_ns);
+    if(p->hardware){
+        printf("Counters per tick, user space only\n");
+    } else if(p->hw_error){
+        printf("Hardware counters unavailable (perf_event_open: %s), times only\n", strerror(p->hw_error));
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "mallsim.h"
+
+/*
+ * Prints a phase profile (MallConfig.profile) as a table: time per tick and share of each
+ * phase of mallsim_step and, when the hardware counters could be read, cycles,
+ * instructions, instructions per cycle and cache misses per tick.
+ */
+void print_profile(const MallProfile* p);
+
+#endif
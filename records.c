@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "records.h"
+
+RecordWriter* open_record_writer(const char* prefix){
+    RecordWriter* w = (RecordWriter*)calloc(1, sizeof(RecordWriter));
+    if(!w){
+        perror("malloc record writer");
+        exit(EXIT_FAILURE);
+    }
+    w->prefix = prefix;
+    w->buffer = (int*)malloc(sizeof(int) * MALLSIM_RECORD_COLUMNS * RECORD_BUFFER_ROWS);
+    if(!w->buffer){
+        perror("malloc record buffer");
+        exit(EXIT_FAILURE);
+    }
+    for(int col=0; col<MALLSIM_RECORD_COLUMNS; col++){
+        char path[4096];
+        snprintf(path, sizeof(path), "%s.%s", prefix, mallsim_record_column(col));
+        w->files[col] = fopen(path, "wb");
+        if(!w->files[col]){
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        // Every write is a whole buffer already; stdio would only copy it once more
+        setvbuf(w->files[col], NULL, _IONBF, 0);
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    return w;
+}
+
+static void flush_columns(RecordWriter* w){
+    if(w->buffered == 0) return;
+    for(int col=0; col<MALLSIM_RECORD_COLUMNS; col++){
+        const int* src = w->buffer + (size_t)col * RECORD_BUFFER_ROWS;
+        if(fwrite(src, sizeof(int), w->buffered, w->files[col]) != (size_t)w->buffered){
+            perror("record file");
+            exit(EXIT_FAILURE);
+        }
+    }
+    w->buffered = 0;
+}
+
+void write_record_block(void* user, const MallRecordBlock* block){
+    RecordWriter* w = (RecordWriter*)user;
+    pthread_mutex_lock(&w->lock);
+    int done = 0;
+    while(done < block->rows){
+        int n = block->rows - done;
+        if(n > RECORD_BUFFER_ROWS - w->buffered) n = RECORD_BUFFER_ROWS - w->buffered;
+        for(int col=0; col<MALLSIM_RECORD_COLUMNS; col++){
+            memcpy(w->buffer + (size_t)col * RECORD_BUFFER_ROWS + w->buffered,
+                   block->column[col] + done, sizeof(int) * n);
+        }
+        w->buffered += n;
+        w->rows += n;
+        done += n;
+        if(w->buffered == RECORD_BUFFER_ROWS) flush_columns(w);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+/*
+ * The manifest says everything a loader needs, e.g. with numpy:
+ *   np.fromfile(prefix + ".wait", dtype=np.int32)
+ */
+long close_record_writer(RecordWriter* w){
+    flush_columns(w);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.columns", w->prefix);
+    FILE* f = fopen(path, "w");
+    if(!f){
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(f, "# Per-customer records: one file per column, %zu-byte native-endian signed integers\n", sizeof(int));
+    fprintf(f, "# direction: %d up, %d down; board: -1 = never boarded; outcome: %d rode, %d stairs, %d gave up, %d balked; class: 0 = no priority\n",
+            MALLSIM_UP, MALLSIM_DOWN, MALLSIM_OUTCOME_RODE, MALLSIM_OUTCOME_STAIRS,
+            MALLSIM_OUTCOME_RENEGED, MALLSIM_OUTCOME_BALKED);
+    fprintf(f, "rows %ld\n", w->rows);
+    for(int col=0; col<MALLSIM_RECORD_COLUMNS; col++){
+        fprintf(f, "column %s int32 %s.%s\n", mallsim_record_column(col), w->prefix, mallsim_record_column(col));
+        fclose(w->files[col]);
+    }
+    fclose(f);
+
+    long rows = w->rows;
+    pthread_mutex_destroy(&w->lock);
+    free(w->buffer);
+    free(w);
+    return rows;
+}
@@ -0,0 +1,34 @@
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "mallsim.h"
+
+/*
+ * Streams per-customer records (MallConfig.records) into one file per column,
+ * <prefix>.<column>, each a plain array of native-endian int32, plus a text manifest
+ * <prefix>.columns. Rows are gathered into large per-column buffers and written a buffer
+ * at a time, so memory stays the same however long the run.
+ */
+#define RECORD_BUFFER_ROWS 262144   // 1 MiB per column between writes
+
+typedef struct {
+    const char* prefix;
+    FILE* files[MALLSIM_RECORD_COLUMNS];
+    int* buffer;              // RECORD_BUFFER_ROWS rows of each column, column after column
+    int buffered;
+    long rows;                // Written or buffered so far
+    pthread_mutex_t lock;     // Building workers hand over blocks concurrently
+} RecordWriter;
+
+RecordWriter* open_record_writer(const char* prefix);
+
+// MallRecordFn: pass the writer as MallConfig.records_user
+void write_record_block(void* user, const MallRecordBlock* block);
+
+// Writes what is still buffered and the manifest; returns the number of rows
+long close_record_writer(RecordWriter* w);
+
+#endif
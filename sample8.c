@@ -1,551 +1,986 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
-#include <semaphore.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <math.h>
 
-// -------------------- Global Variables (replacing original macros) --------------------
-// Instead of using fixed macros for capacity and max customers, we use global variables
-// which will be assigned values from user input in main().
-static int g_escalator_capacity  = 13; // Must not exceed 13, will be parsed from user input
-static int g_mall_capacity       = 30; // Must not exceed 30, will be parsed from user input
-
-#define UP    1
-#define DOWN -1
-#define IDLE  0
-
-// -------------------- Global Mutex + Semaphores --------------------
-static pthread_mutex_t mall_mutex;
-static sem_t escalator_capacity_sem; 
-
-// -------------------- Data Structures --------------------
-typedef struct Customer {
-    int id;
-    int arrival_time;  // Arrival time (seconds)
-    int direction;     // UP or DOWN
-    int position;      // 0 or 14 (kept as in original code)
-    struct Customer* next;
-    struct Customer* prev;
-} Customer;
-
-typedef struct {
-    Customer* head;
-    Customer* tail;
-    int length;
-    int direction; // 1=UP, -1=DOWN
-} Queue;
+#include "mallsim.h"
+#include "pacer.h"
+#include "metrics.h"
+#include "records.h"
+#include "golden.h"
+#include "series.h"
+#include "stopping.h"
+#include "profile.h"
 
 /*
- * In the Escalator structure, the 'steps' array was originally sized by MAX_ESCALATOR_CAPACITY.
- * We keep its physical size at 13, but we only use the first g_escalator_capacity elements logically.
- * (Because user input cannot exceed 13, this is safe.)
+ * Command-line front end of the simulation library (mallsim.h): it parses the options
+ * into a MallConfig, paces and prints the classic run, and formats the results of the
+ * building, comparison and benchmark modes. All simulation logic lives in mallsim.c.
  */
-typedef struct {
-    Customer* steps[13];  
-    int direction; // UP / DOWN / IDLE
-    int num_people; 
-} Escalator;
 
-typedef struct {
-    Queue* upQueue;
-    Queue* downQueue;
-    Escalator* escalator;
-    int total_customers;
-    int current_time;
-} Mall;
-
-// Customer thread argument structure
-typedef struct {
-    int direction;     // Direction
-    int arrival_time;  // Arrival time
-} CustomerThreadArgs;
+// Optional metrics file (--metrics-file), rewritten every g_metrics_interval_ms
+static const char* g_metrics_path = NULL;
+static int g_metrics_interval_ms = 1000;
+
+// Optional per-customer columns (--records <prefix>) of the classic and building runs
+static const char* g_records_prefix = NULL;
 
-// -------------------- Global Variables --------------------
-static int total_turnaround_time = 0;
-static int completed_customers   = 0;
+// Optional time series of the classic run (--window <sec>, --window-file <path>)
+static int g_window = 0;
+static const char* g_window_path = NULL;
 
-// Tracks how many people have boarded in the current direction (used for forced direction switching)
-static int current_dir_boarded_count = 0;
+// Phase profile of the classic run
+static int g_profile = 0;
+
+// Log callback of the classic run: the per-tick lines go straight to stdout
+static void print_log(void* user, const char* text){
+    (void)user;
+    fputs(text, stdout);
+}
 
-// Global auto-increment ID for customers
-static int global_customer_id = 0;
+// Flight recorder dumps go to stderr, apart from the (possibly huge or discarded) tick log
+static void print_flight_dump(void* user, const char* text){
+    (void)user;
+    fputs(text, stderr);
+}
 
-Mall* mall = NULL;
-static int simulation_running = 1;
+// Head-of-line summary shared by the classic and building runs
+static void print_head_waits(const MallConfig* cfg, const MallResult* r){
+    printf("Longest queue wait of a queue head = %d sec\n", r->worst_head_queue_wait);
+    if(cfg->wait_bound > 0){
+        printf("Longest time at the front of a queue = %d sec (bound %d), %d boardings held back, %d phases cut short\n",
+               r->worst_front_wait, cfg->wait_bound, r->bound_holds, r->bound_switches);
+    }
+    if(cfg->flight_wait > 0){
+        printf("Flight recorder dumps: %d (queue heads waiting >= %d sec, last %d ticks each)\n",
+               r->flight_dumps, cfg->flight_wait, cfg->flight_ticks);
+    }
+}
 
-// -------------------- Function Declarations --------------------
-Queue* init_queue(int dir);
-Escalator* init_escalator();
-Mall* init_mall();
-Customer* create_customer_struct(int direction, int arrival_time);
+// Per-class waits, with priority classes
+static void print_class_waits(const MallConfig* cfg, const MallResult* r){
+    if(cfg->classes < 2) return;
+    for(int k=0; k<cfg->classes; k++){
+        printf("Class %d (%s, weight %d): %d customers, %d boardings, wait mean %.2f sec, p99 %d sec, max %d sec\n",
+               k, k ? "priority" : "regular", cfg->class_weight[k], r->class_customers[k], r->class_boarded[k],
+               r->class_boarded[k] ? (double)r->class_wait[k] / r->class_boarded[k] : 0.0,
+               mallsim_percentile(r->class_wait_hist[k], 99), r->class_wait_max[k]);
+    }
+}
 
-void enqueue(Queue* q, Customer* c);
-Customer* dequeue(Queue* q);
+// Outage summary shared by the classic and building runs
+static void print_outages(const MallConfig* cfg, const MallResult* r){
+    if(cfg->outage_length == 0 && cfg->breakdown_mtbf == 0) return;
+    printf("Outages: %d stops, %ld sec stopped, %d episodes, %d recovered",
+           r->outages, r->counters.outage_ticks, r->outage_episodes, r->outage_recoveries);
+    if(r->outage_recoveries > 0){
+        printf(" (recovery mean %.1f sec, worst %d sec)",
+               (double)r->outage_recovery_total / r->outage_recoveries, r->outage_recovery_worst);
+    }
+    if(r->outage_unmeasured > 0) printf(", %d too early to measure", r->outage_unmeasured);
+    printf("\n");
+    if(r->outage_episodes == 0) return;
+    long boarded = r->counters.boarded - r->outage_boardings;
+    printf("During episodes: peak queue %d; queued through a stop: wait mean %.1f sec, max %d sec (otherwise mean %.1f sec)\n",
+           r->outage_peak_queue,
+           r->outage_boardings ? (double)r->outage_wait / r->outage_boardings : 0.0,
+           r->outage_peak_wait,
+           boarded > 0 ? (double)(r->total_wait - r->outage_wait) / boarded : 0.0);
+}
 
-int can_customer_board(Customer* c);
-void board_customer(Customer* c);
-void operate_escalator();
-void print_escalator_status();
+static RecordWriter* attach_records(MallConfig* cfg){
+    if(!g_records_prefix) return NULL;
+    RecordWriter* w = open_record_writer(g_records_prefix);
+    cfg->records = write_record_block;
+    cfg->records_user = w;
+    return w;
+}
 
-// The mall_control_loop no longer randomly generates customers.
-// It only handles transporting already created customers.
-void mall_control_loop();
+// After the simulation is destroyed, when every row has been handed over
+static void finish_records(RecordWriter* w){
+    if(!w) return;
+    long rows = close_record_writer(w);
+    printf("Per-customer records: %ld rows, columns in %s.columns\n", rows, g_records_prefix);
+}
 
-void cleanup_resources();
+static WindowSeries* attach_windows(MallConfig* cfg){
+    if(g_window == 0) return NULL;
+    WindowSeries* s = open_window_series(g_window_path);
+    cfg->window = g_window;
+    cfg->windows = add_window;
+    cfg->windows_user = s;
+    return s;
+}
 
-// New: Customer thread function
-void* customer_thread(void* arg);
+// After the simulation is destroyed, when the last window has been handed over
+static void finish_windows(WindowSeries* s){
+    if(!s) return;
+    close_window_series(s, g_window);
+    if(g_window_path) printf("Time series: %d sec windows in %s\n", g_window, g_window_path);
+}
 
-// --------------------------------------------------
-// Initialization
-// --------------------------------------------------
-Queue* init_queue(int dir) {
-    pthread_mutex_lock(&mall_mutex);
-    Queue* q = (Queue*)malloc(sizeof(Queue));
-    if(!q){
-        perror("malloc queue");
-        exit(EXIT_FAILURE);
-    }
-    q->head = NULL;
-    q->tail = NULL;
-    q->length = 0;
-    q->direction = dir; 
-    pthread_mutex_unlock(&mall_mutex);
-    return q;
+static double elapsed_seconds(struct timespec* start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
 }
 
-Escalator* init_escalator(){
-    pthread_mutex_lock(&mall_mutex);
-    Escalator* e = (Escalator*)malloc(sizeof(Escalator));
-    if(!e){
-        perror("malloc escalator");
-        exit(EXIT_FAILURE);
-    }
-    for(int i=0; i<13; i++){
-        e->steps[i] = NULL;
-    }
-    e->direction = IDLE;
-    e->num_people= 0;
-    pthread_mutex_unlock(&mall_mutex);
-    return e;
+static int behaviours_enabled(const MallConfig* cfg){
+    return cfg->balk_length > 0 || cfg->patience > 0;
 }
 
-Mall* init_mall(){
-    pthread_mutex_lock(&mall_mutex);
-    Mall* m = (Mall*)malloc(sizeof(Mall));
-    if(!m){
-        perror("malloc mall");
-        exit(EXIT_FAILURE);
-    }
-    m->upQueue   = init_queue(UP);
-    m->downQueue = init_queue(DOWN);
-    m->escalator = init_escalator();
-    m->total_customers=0;
-    m->current_time=0;
-    pthread_mutex_unlock(&mall_mutex);
-    return m;
-}
-
-// Create Customer Structure (non-thread, just the data)
-Customer* create_customer_struct(int direction, int arrival_time) {
-    pthread_mutex_lock(&mall_mutex);
-    global_customer_id++;
-    Customer* c = (Customer*)malloc(sizeof(Customer));
-    c->id = global_customer_id;
-    c->arrival_time = arrival_time;
-    c->direction    = direction;
-    // Original code uses 0 or 14 for position, not changed.
-    c->position     = (direction==UP) ? 0 : 14;
-    c->next = NULL;
-    c->prev = NULL;
-    pthread_mutex_unlock(&mall_mutex);
-    return c;
-}
-
-// Customer Thread Function
-void* customer_thread(void* arg) {
-    CustomerThreadArgs* args = (CustomerThreadArgs*)arg;
-    
-    pthread_mutex_lock(&mall_mutex);
-    int direction = args->direction;
-    int arrival_time = args->arrival_time;
-    
-    // Create the data structure
-    Customer* c = create_customer_struct(direction, arrival_time);
-    
-    // Increase total number of customers in the mall
-    mall->total_customers++;
-    
-    // Insert customer into the appropriate queue
-    if (direction == UP) {
-        enqueue(mall->upQueue, c);
-    } else {
-        enqueue(mall->downQueue, c);
-    }
-    
-    pthread_mutex_unlock(&mall_mutex);
-    
-    // Free the argument memory
-    free(args);
-    
-    // Thread exit
-    return NULL;
-}
-
-// Create Customer (start a new thread)
-void create_customer(int direction) {
-    // Prepare thread arguments
-    CustomerThreadArgs* args = (CustomerThreadArgs*)malloc(sizeof(CustomerThreadArgs));
-    if (!args) {
-        perror("malloc customer thread args");
-        exit(EXIT_FAILURE);
-    }
-    
-    args->direction = direction;
-    
-    pthread_mutex_lock(&mall_mutex);
-    args->arrival_time = mall->current_time;
-    pthread_mutex_unlock(&mall_mutex);
-    
-    // Create thread
-    pthread_t thread_id;
-    if (pthread_create(&thread_id, NULL, customer_thread, args) != 0) {
-        perror("pthread_create");
-        free(args);
+static MallResult* alloc_results(int n){
+    MallResult* r = (MallResult*)malloc(sizeof(MallResult) * n);
+    if(!r){
+        perror("malloc results");
         exit(EXIT_FAILURE);
     }
-    
-    // Detach thread to let it exit independently
-    pthread_detach(thread_id);
-    
-    printf("Customer thread created, direction: %s\n", (direction==UP)?"Up":"Down");
+    return r;
+}
+
+// The library reports running out of memory instead of exiting; the program gives up
+static void simulation_out_of_memory(void){
+    fprintf(stderr, "Error: the simulation ran out of memory.\n");
+    exit(EXIT_FAILURE);
+}
+
+// Runs a configuration that has already been checked, so a failure can only be memory
+static void run_mall(const MallConfig* cfg, MallResult* r){
+    if(mallsim_run(cfg, r) != 0) simulation_out_of_memory();
 }
 
 // --------------------------------------------------
-// Queue Operations
+// Classic run: one mall, paced, every tick printed
 // --------------------------------------------------
-void enqueue(Queue* q, Customer* c){
-    pthread_mutex_lock(&mall_mutex);
-    if(!q->head){
-        q->head = c;
-        q->tail = c;
-    } else {
-        q->tail->next = c;
-        c->prev       = q->tail;
-        q->tail       = c;
-    }
-    q->length++;
-    printf("Customer %d joined the queue, direction: %s, arrival time: %d\n",
-           c->id, 
-           (q->direction==UP)?"Up":"Down", 
-           c->arrival_time);
-    pthread_mutex_unlock(&mall_mutex);
-}
-
-Customer* dequeue(Queue* q){
-    pthread_mutex_lock(&mall_mutex);
-    if(!q->head){
-        pthread_mutex_unlock(&mall_mutex);
-        return NULL;
-    }
-    Customer* c = q->head;
-    q->head     = c->next;
-    if(!q->head){
-        q->tail = NULL;
+static void classic_simulation(MallConfig* cfg, int tick_ms){
+    cfg->log = print_log;
+    RecordWriter* records = attach_records(cfg);
+    WindowSeries* windows = attach_windows(cfg);
+    MallProfile profile;
+    if(g_profile){
+        mallsim_profile_open(&profile, 1);
+        cfg->profile = &profile;
+    }
+    MallSim* sim = mallsim_create(cfg);
+    if(!sim) simulation_out_of_memory();
+
+    MetricsPublisher* pub = NULL;
+    const MallCounters* counters = mallsim_counters(sim);
+    if(g_metrics_path){
+        pub = start_metrics_publisher(g_metrics_path, g_metrics_interval_ms, &counters, 1);
+    }
+    Pacer pacer;
+    pacer_start(&pacer, tick_ms);
+    int more;
+    while((more = mallsim_step(sim)) > 0){
+        pacer_wait(&pacer);
+    }
+    if(more < 0) simulation_out_of_memory();
+    if(pub){
+        stop_metrics_publisher(pub);
+    }
+
+    MallResult* r = alloc_results(1);
+    mallsim_result(sim, r);
+    printf("\n===== Simulation Ended =====\n");
+    printf("Remaining customers: %d\n", r->remaining);
+    if(r->completed > 0){
+        double avg = (double)r->total_turnaround / r->completed;
+        printf("Average turnaround time = %.2f sec\n", avg);
     } else {
-        q->head->prev = NULL;
+        printf("No customers completed their ride?\n");
+    }
+    if(behaviours_enabled(cfg)){
+        printf("Balked = %d, gave up = %d, took the stairs = %d\n",
+               r->balked, r->reneged, r->rerouted);
+    }
+    print_head_waits(cfg, r);
+    print_class_waits(cfg, r);
+    print_outages(cfg, r);
+    pacer_report(&pacer);
+    free(r);
+    mallsim_destroy(sim);
+    finish_records(records);
+    finish_windows(windows);
+    if(g_profile){
+        print_profile(&profile);
+        mallsim_profile_close(&profile);
     }
-    q->length--;
-    pthread_mutex_unlock(&mall_mutex);
-    return c;
 }
 
 // --------------------------------------------------
-// Check if a Customer Can Board the Escalator
+// Building: several escalators stepped in parallel
 // --------------------------------------------------
-int can_customer_board(Customer* c){
-    pthread_mutex_lock(&mall_mutex);
-    Escalator* e = mall->escalator;
 
-    // If the escalator is full, they cannot board
-    if(e->num_people >= g_escalator_capacity) {
-        pthread_mutex_unlock(&mall_mutex);
-        return 0;
+// Run a building once with the given thread count and print its summary
+static void building_simulation(const MallConfig* cfg, int num_escalators, int customers_per_escalator, int num_threads){
+    MallConfig run_cfg = *cfg;
+    RecordWriter* records = attach_records(&run_cfg);
+    MallBuilding* b = mallsim_building_create(&run_cfg, num_escalators, customers_per_escalator);
+    if(!b) simulation_out_of_memory();
+    MetricsPublisher* pub = NULL;
+    const MallCounters** counters = NULL;
+    if(g_metrics_path){
+        counters = (const MallCounters**)malloc(sizeof(MallCounters*) * num_escalators);
+        if(!counters){
+            perror("malloc metrics counters");
+            exit(EXIT_FAILURE);
+        }
+        for(int k=0; k<num_escalators; k++){
+            counters[k] = mallsim_building_counters(b, k);
+        }
+        pub = start_metrics_publisher(g_metrics_path, g_metrics_interval_ms, counters, num_escalators);
     }
-    
-    // If the escalator is idle, customer can board and set direction
-    if(e->direction == IDLE){
-        e->direction = c->direction;
-        current_dir_boarded_count = 0;
-        pthread_mutex_unlock(&mall_mutex);
-        return 1;
+    int threads = mallsim_building_run(b, num_threads);
+    if(pub){
+        stop_metrics_publisher(pub);
+    }
+    free(counters);
+
+    MallResult* r = alloc_results(1);
+    if(threads < 0 || mallsim_building_result(b, r) != 0) simulation_out_of_memory();
+
+    printf("===== Building Simulation Ended =====\n");
+    printf("Escalators: %d, threads: %d, ticks: %d\n", num_escalators, threads, r->ticks);
+    printf("Completed customers: %d\n", r->completed);
+    if(r->completed > 0){
+        printf("Average turnaround time = %.2f sec\n", (double)r->total_turnaround / r->completed);
+    }
+    if(behaviours_enabled(cfg)){
+        printf("Balked = %d, gave up = %d, took the stairs = %d\n", r->balked, r->reneged, r->rerouted);
     }
-    
-    // If escalator direction matches the customer's direction, allow boarding
-    if(e->direction == c->direction){
-        // If we already boarded >=5 people in this direction AND there are people waiting in the opposite queue => deny
-        Queue* oppQ = (c->direction==UP)? mall->downQueue: mall->upQueue;
-        if(oppQ->length>0 && current_dir_boarded_count>=5){
-            pthread_mutex_unlock(&mall_mutex);
-            return 0; 
+    print_head_waits(cfg, r);
+    print_class_waits(cfg, r);
+    print_outages(cfg, r);
+    printf("Completion checksum: %016lx\n", r->checksum);
+    free(r);
+    mallsim_building_destroy(b);
+    finish_records(records);
+}
+
+/*
+ * Scaling benchmark: the same seeded building is rebuilt and run with 1..max_threads
+ * workers. Every run must reproduce the single-threaded checksum.
+ */
+static int building_scaling_benchmark(const MallConfig* cfg, int num_escalators, int customers_per_escalator, int max_threads){
+    printf("Scaling benchmark: %d escalators, %d customers per escalator, seed %u\n",
+           num_escalators, customers_per_escalator, cfg->seed);
+    printf("%8s %8s %12s %8s %18s\n", "threads", "ticks", "seconds", "speedup", "checksum");
+
+    MallResult* r = alloc_results(1);
+    double base = 0.0;
+    unsigned long base_checksum = 0;
+    int mismatches = 0;
+    for(int t=1; t<=max_threads; t++){
+        MallBuilding* b = mallsim_building_create(cfg, num_escalators, customers_per_escalator);
+        if(!b) simulation_out_of_memory();
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int threads = mallsim_building_run(b, t);
+        double secs = elapsed_seconds(&start);
+
+        if(threads < 0 || mallsim_building_result(b, r) != 0) simulation_out_of_memory();
+        if(t == 1){
+            base = secs;
+            base_checksum = r->checksum;
+        } else if(r->checksum != base_checksum){
+            mismatches++;
         }
-        pthread_mutex_unlock(&mall_mutex);
+        printf("%8d %8d %12.6f %8.2f %18lx%s\n", threads, r->ticks, secs,
+               (secs > 0) ? base / secs : 0.0, r->checksum,
+               (r->checksum != base_checksum) ? "  MISMATCH" : "");
+        mallsim_building_destroy(b);
+    }
+    free(r);
+    if(mismatches){
+        fprintf(stderr, "Error: %d thread counts diverged from the single-threaded run.\n", mismatches);
         return 1;
     }
-    
-    // Opposite direction => cannot board
-    pthread_mutex_unlock(&mall_mutex);
     return 0;
 }
 
 // --------------------------------------------------
-// Customer Boards the Escalator
+// Reversible escalator vs. dedicated pair (virtual time)
 // --------------------------------------------------
-void board_customer(Customer* c){
-    sem_wait(&escalator_capacity_sem); // Acquire lock for escalator capacity
-
-    pthread_mutex_lock(&mall_mutex);
-    Escalator* e = mall->escalator;
-    
-    // Determine entry index
-    int entry = (c->direction==UP)? 0 : (g_escalator_capacity - 1);
-    e->steps[entry] = c;
-    e->num_people++;
-    current_dir_boarded_count++;
-    int wait_time = mall->current_time - c->arrival_time;
-    printf("Customer %d boarded the escalator, direction: %s, wait time=%d sec, transported=%d people\n",
-           c->id, 
-           (c->direction==UP)?"Up":"Down",
-           wait_time, current_dir_boarded_count);
-    pthread_mutex_unlock(&mall_mutex);
+
+/*
+ * Runs the reversible escalator and a pair of one-way escalators on the same seeded arrival
+ * stream and prints throughput, wait percentiles and step utilisation side by side.
+ */
+static void compare_escalator_pair(const MallConfig* base){
+    const char* names[2] = { "reversible", "pair" };
+    MallResult* st = alloc_results(2);
+    int p50[2], p90[2], p99[2], pmax[2];
+    for(int v=0; v<2; v++){
+        MallConfig cfg = *base;
+        cfg.pair = v;
+        run_mall(&cfg, &st[v]);
+        p50[v]  = mallsim_percentile(st[v].wait_hist, 50);
+        p90[v]  = mallsim_percentile(st[v].wait_hist, 90);
+        p99[v]  = mallsim_percentile(st[v].wait_hist, 99);
+        pmax[v] = mallsim_percentile(st[v].wait_hist, 100);
+    }
+
+    printf("===== Reversible vs. Pair Comparison =====\n");
+    printf("Steps: %d, initial customers: %d, arrivals until: %d sec, mall capacity: %d, seed: %u\n",
+           base->escalator_steps, base->initial_customers, base->arrival_seconds, base->mall_capacity, base->seed);
+    printf("%-28s %12s %12s\n", "", names[0], names[1]);
+    printf("%-28s %12d %12d\n", "Customers served", st[0].completed, st[1].completed);
+    printf("%-28s %12d %12d\n", "Turned away (mall full)", st[0].rejected, st[1].rejected);
+    printf("%-28s %12d %12d\n", "Ticks until empty", st[0].ticks, st[1].ticks);
+    printf("%-28s %12.3f %12.3f\n", "Throughput (customers/sec)",
+           (double)st[0].completed / st[0].ticks, (double)st[1].completed / st[1].ticks);
+    printf("%-28s %12.2f %12.2f\n", "Average turnaround (sec)",
+           st[0].completed ? (double)st[0].total_turnaround / st[0].completed : 0.0,
+           st[1].completed ? (double)st[1].total_turnaround / st[1].completed : 0.0);
+    printf("%-28s %12d %12d\n", "Wait p50 (sec)", p50[0], p50[1]);
+    printf("%-28s %12d %12d\n", "Wait p90 (sec)", p90[0], p90[1]);
+    printf("%-28s %12d %12d\n", "Wait p99 (sec)", p99[0], p99[1]);
+    printf("%-28s %12d %12d\n", "Wait max (sec)", pmax[0], pmax[1]);
+    printf("%-28s %11.1f%% %11.1f%%\n", "Occupied steps",
+           100.0 * st[0].counters.occupied_step_ticks / st[0].counters.step_ticks,
+           100.0 * st[1].counters.occupied_step_ticks / st[1].counters.step_ticks);
+    printf("%-28s %11.1f%% %11.1f%%\n", "Idle escalator-ticks",
+           100.0 * st[0].counters.idle_unit_ticks / st[0].counters.unit_ticks,
+           100.0 * st[1].counters.idle_unit_ticks / st[1].counters.unit_ticks);
+    printf("%-28s %12ld %12ld\n", "Direction switches",
+           st[0].counters.direction_switches, st[1].counters.direction_switches);
+    printf("%-28s %12ld %12ld\n", "Ticks lost draining",
+           st[0].counters.drain_ticks, st[1].counters.drain_ticks);
+    free(st);
 }
 
-// --------------------------------------------------
-// Move Customers on the Escalator Every Second
-// --------------------------------------------------
-void operate_escalator(){
-    pthread_mutex_lock(&mall_mutex);
-    Escalator* e = mall->escalator;
-    if(e->num_people>0){
-        printf("Escalator direction = %s, Passengers = %d\n",
-               (e->direction==UP)?"Up":
-               (e->direction==DOWN)?"Down":"Idle",
-               e->num_people);
-
-        // Moving up
-        if(e->direction==UP){
-            // Disembark at the top
-            if(e->steps[g_escalator_capacity-1]){
-                Customer* c = e->steps[g_escalator_capacity-1];
-                int tat = mall->current_time - c->arrival_time;
-                printf("Customer %d completed upward travel, Turnaround time = %d sec\n", c->id, tat);
-                total_turnaround_time += tat;
-                completed_customers++;
-                free(c);
-                e->steps[g_escalator_capacity-1] = NULL;
-                e->num_people--;
-                mall->total_customers--;
-                sem_post(&escalator_capacity_sem);
-            }
-            // Shift everyone else up by 1
-            for(int i=g_escalator_capacity-2; i>=0; i--){
-                if(e->steps[i]){
-                    e->steps[i+1]=e->steps[i];
-                    e->steps[i]=NULL;
-                }
-            }
+/*
+ * Single file vs. stand right / walk left on the same seeded arrivals and behaviours:
+ * the second run only adds the walking lane and who walks how fast.
+ */
+static void compare_lanes(const MallConfig* base){
+    const char* names[2] = { "single lane", "walk left" };
+    MallResult* st = alloc_results(2);
+    int p50[2], p99[2];
+    double thr[2];
+    for(int v=0; v<2; v++){
+        MallConfig cfg = *base;
+        cfg.lanes = v ? 2 : 1;
+        run_mall(&cfg, &st[v]);
+        p50[v] = mallsim_percentile(st[v].wait_hist, 50);
+        p99[v] = mallsim_percentile(st[v].wait_hist, 99);
+        thr[v] = st[v].ticks ? (double)st[v].completed / st[v].ticks : 0.0;
+    }
+
+    printf("===== Single Lane vs. Stand Right / Walk Left =====\n");
+    printf("Steps: %d, initial customers: %d, arrivals until: %d sec, walkers: %d%% at 2..%d steps/sec, seed: %u\n",
+           base->escalator_steps, base->initial_customers, base->arrival_seconds,
+           base->walker_percent, base->walk_speed_max, base->seed);
+    printf("%-28s %12s %12s\n", "", names[0], names[1]);
+    printf("%-28s %12d %12d\n", "Customers served", st[0].completed, st[1].completed);
+    printf("%-28s %12d %12d\n", "Of whom walked", 0, st[1].walkers);
+    printf("%-28s %12d %12d\n", "Turned away (mall full)", st[0].rejected, st[1].rejected);
+    printf("%-28s %12d %12d\n", "Ticks until empty", st[0].ticks, st[1].ticks);
+    printf("%-28s %12.3f %12.3f   (%+.1f%%)\n", "Throughput (customers/sec)", thr[0], thr[1],
+           thr[0] > 0 ? 100.0 * (thr[1] - thr[0]) / thr[0] : 0.0);
+    printf("%-28s %12.2f %12.2f\n", "Average turnaround (sec)",
+           st[0].completed ? (double)st[0].total_turnaround / st[0].completed : 0.0,
+           st[1].completed ? (double)st[1].total_turnaround / st[1].completed : 0.0);
+    printf("%-28s %12.2f %12.2f\n", "Average wait (sec)",
+           st[0].completed ? (double)st[0].total_wait / st[0].completed : 0.0,
+           st[1].completed ? (double)st[1].total_wait / st[1].completed : 0.0);
+    printf("%-28s %12d %12d\n", "Wait p50 (sec)", p50[0], p50[1]);
+    printf("%-28s %12d %12d\n", "Wait p99 (sec)", p99[0], p99[1]);
+    printf("%-28s %11.1f%% %11.1f%%\n", "Occupied places",
+           100.0 * st[0].counters.occupied_step_ticks / st[0].counters.step_ticks,
+           100.0 * st[1].counters.occupied_step_ticks / st[1].counters.step_ticks);
+    printf("%-28s %12ld %12ld\n", "Direction switches",
+           st[0].counters.direction_switches, st[1].counters.direction_switches);
+    printf("%-28s %12ld %12ld\n", "Ticks lost draining",
+           st[0].counters.drain_ticks, st[1].counters.drain_ticks);
+    free(st);
+}
+
+/*
+ * Batch sizes compared with common random numbers: every replication's arrivals are drawn
+ * once and shared by all the batch sizes, and each is compared with the first on paired
+ * differences. The same comparison on independent seeds shows what the pairing saves.
+ */
+static int compare_batch_sizes(const MallConfig* base, const int* sizes, int n, int reps, int threads){
+    MallConfig* variants = (MallConfig*)malloc(sizeof(MallConfig) * n);
+    MallVariantResult* res = (MallVariantResult*)malloc(sizeof(MallVariantResult) * 2 * n);
+    if(!variants || !res){
+        perror("malloc comparison");
+        exit(EXIT_FAILURE);
+    }
+    for(int v=0; v<n; v++){
+        variants[v] = *base;
+        variants[v].batch_size = sizes[v];
+    }
+    MallCompareSpec spec;
+    mallsim_default_compare(&spec);
+    spec.replications = reps;
+    spec.threads = threads;
+    double secs[2];
+    for(int mode=0; mode<2; mode++){
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        spec.common = (mode == 0);
+        if(mallsim_compare(variants, n, &spec, &res[mode * n]) != 0){
+            fprintf(stderr, "Error: invalid comparison.\n");
+            return 1;
         }
-        // Moving down
-        else if(e->direction==DOWN){
-            // Disembark at the bottom
-            if(e->steps[0]){
-                Customer* c = e->steps[0];
-                int tat = mall->current_time - c->arrival_time;
-                printf("Customer %d completed downward travel, Turnaround time = %d sec\n", c->id, tat);
-                total_turnaround_time += tat;
-                completed_customers++;
-                free(c);
-                e->steps[0] = NULL;
-                e->num_people--;
-                mall->total_customers--;
-                sem_post(&escalator_capacity_sem);
-            }
-            // Shift everyone else down by 1
-            for(int i=1; i<g_escalator_capacity; i++){
-                if(e->steps[i]){
-                    e->steps[i-1]=e->steps[i];
-                    e->steps[i]=NULL;
-                }
-            }
+        secs[mode] = elapsed_seconds(&start);
+    }
+
+    printf("===== Batch Size Comparison (common random numbers) =====\n");
+    printf("Steps: %d, initial customers: %d, arrivals until: %d sec, mall capacity: %d, %d replications from seed %u\n",
+           base->escalator_steps, base->initial_customers, base->arrival_seconds, base->mall_capacity,
+           reps, base->seed);
+    printf("%-8s %22s %22s\n", "Batch", "Wait (sec)", "Turnaround (sec)");
+    for(int v=0; v<n; v++){
+        printf("%-8d %12.2f +- %6.2f %12.2f +- %6.2f\n", sizes[v], res[v].wait_mean, res[v].wait_half,
+               res[v].turnaround_mean, res[v].turnaround_half);
+    }
+    printf("Wait difference vs. batch %d (95%% CI):\n", sizes[0]);
+    printf("%-8s %22s %22s %14s\n", "Batch", "paired", "independent seeds", "runs saved");
+    for(int v=1; v<n; v++){
+        const MallVariantResult* crn = &res[v];
+        const MallVariantResult* ind = &res[n + v];
+        printf("%-8d %12.2f +- %6.2f %12.2f +- %6.2f", sizes[v], crn->wait_diff, crn->wait_diff_half,
+               ind->wait_diff, ind->wait_diff_half);
+        // Replications scale with the square of the half-width
+        if(crn->wait_diff_half > 0){
+            double ratio = ind->wait_diff_half / crn->wait_diff_half;
+            printf(" %13.1fx\n", ratio * ratio);
+        } else {
+            printf(" %14s\n", "exact");
         }
+    }
+    printf("Time: %.3f sec paired, %.3f sec independent (%d runs each)\n", secs[0], secs[1], n * reps);
+    free(res);
+    free(variants);
+    return 0;
+}
 
-        // If escalator is now empty, decide whether to force a direction switch
-        if(e->num_people==0){
-            printf("Escalator is now empty. Passengers transported in this direction = %d\n", current_dir_boarded_count);
+/*
+ * Agent benchmark: n customers arrive at once at a single escalator with no capacity
+ * limit, so up to n agents are suspended at the same time.
+ */
+static void agent_scaling_benchmark(const MallConfig* base, int n){
+    MallConfig cfg = *base;
+    cfg.initial_customers = n;
+    cfg.mall_capacity = n;
+    if(cfg.patience == 0) cfg.patience = 600;
 
-            // If we have transported >=5 people and there are people waiting in the opposite direction => switch direction
-            Queue* oppQ = (e->direction==UP)? mall->downQueue: mall->upQueue;
-            int oppLen  = oppQ->length;
+    MallResult* r = alloc_results(1);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    run_mall(&cfg, r);
+    double secs = elapsed_seconds(&start);
 
-            if(current_dir_boarded_count>=5 && oppLen>0){
-                printf(">=5 people have crossed, and there are customers waiting in the opposite direction. Forcing direction switch to %s\n",
-                       (e->direction==UP)?"Down":"Up");
-                e->direction = - e->direction; 
-            } else {
-                e->direction = IDLE;
-            }
-            // Reset count
-            current_dir_boarded_count=0;
+    size_t agent = mallsim_agent_size();
+    printf("===== Agent Benchmark =====\n");
+    printf("Agents: %d, peak concurrent: %d, bytes per agent: %zu (%.1f MB total)\n",
+           n, r->peak_customers, agent, (double)r->peak_customers * agent / (1024.0 * 1024.0));
+    printf("Completed = %d, balked = %d, gave up = %d, took the stairs = %d, ticks = %d\n",
+           r->completed, r->balked, r->reneged, r->rerouted, r->ticks);
+    printf("Agent resumes: %ld in %.3f sec (%.0f resumes/sec)\n",
+           r->agent_resumes, secs, secs > 0 ? r->agent_resumes / secs : 0.0);
+    free(r);
+}
+
+/*
+ * Library benchmark: n independent evaluations of the configured mall (seeds seed,
+ * seed+1, ...) in this process, the way an embedding planner would call mallsim_run.
+ */
+static void library_run_benchmark(const MallConfig* base, int n){
+    MallConfig cfg = *base;
+    MallResult* r = alloc_results(1);
+    long completed = 0;
+    double turnaround = 0.0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i=0; i<n; i++){
+        cfg.seed = base->seed + (unsigned int)i;
+        run_mall(&cfg, r);
+        completed += r->completed;
+        turnaround += r->completed ? (double)r->total_turnaround / r->completed : 0.0;
+    }
+    double secs = elapsed_seconds(&start);
+
+    printf("===== Library Benchmark =====\n");
+    printf("Evaluations: %d, steps: %d, customers: %d, arrivals until: %d sec\n",
+           n, cfg.escalator_steps, cfg.initial_customers, cfg.arrival_seconds);
+    printf("Mean customers served = %.2f, mean average turnaround = %.2f sec\n",
+           (double)completed / n, turnaround / n);
+    printf("%.3f sec total, %.2f us per evaluation (%.0f evaluations/sec)\n",
+           secs, secs * 1e6 / n, secs > 0 ? n / secs : 0.0);
+    free(r);
+}
+
+/*
+ * Batch benchmark: n instances of the configured closed mall (seeds seed, seed+1, ...),
+ * one at a time through mallsim_run and in lockstep through mallsim_batch_run. Every
+ * instance must come out the same from both.
+ */
+static int batch_benchmark(const MallConfig* base, int n){
+    MallConfig* cfgs = (MallConfig*)malloc(sizeof(MallConfig) * n);
+    MallBatchResult* batch = (MallBatchResult*)malloc(sizeof(MallBatchResult) * n);
+    if(!cfgs || !batch){
+        perror("malloc batch");
+        exit(EXIT_FAILURE);
+    }
+    for(int i=0; i<n; i++){
+        cfgs[i] = *base;
+        cfgs[i].seed = base->seed + (unsigned int)i;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if(mallsim_batch_run(cfgs, n, batch) != 0){
+        fprintf(stderr, "Error: the batch engine only runs closed malls of at most %d customers "
+                        "(no arrivals, pair, walkers, priority, outages, behaviours or wait bound).\n",
+                MALLSIM_BATCH_MAX_CUSTOMERS);
+        free(cfgs);
+        free(batch);
+        return 1;
+    }
+    double batch_secs = elapsed_seconds(&start);
+
+    MallResult* r = alloc_results(1);
+    int mismatches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i=0; i<n; i++){
+        run_mall(&cfgs[i], r);
+        const MallBatchResult* b = &batch[i];
+        if(b->ticks == r->ticks && b->completed == r->completed && b->total_turnaround == r->total_turnaround &&
+           b->total_wait == r->total_wait && b->checksum == r->checksum &&
+           b->direction_switches == r->counters.direction_switches) continue;
+        if(mismatches++ < 5){
+            fprintf(stderr, "MISMATCH seed %u: ticks %d/%d, completed %d/%d, turnaround %ld/%ld, wait %ld/%ld, switches %ld/%ld\n",
+                    cfgs[i].seed, r->ticks, b->ticks, r->completed, b->completed, r->total_turnaround,
+                    b->total_turnaround, r->total_wait, b->total_wait, r->counters.direction_switches,
+                    b->direction_switches);
         }
     }
-    pthread_mutex_unlock(&mall_mutex);
+    double scalar_secs = elapsed_seconds(&start);
+
+    printf("===== Batch Benchmark =====\n");
+    printf("Instances: %d, steps: %d, customers: %d, batch size: %d, %d instances per vector\n",
+           n, base->escalator_steps, base->initial_customers, base->batch_size, MALLSIM_BATCH_LANES);
+    printf("%-8s %8.3f sec %12.0f instances/sec\n", "scalar", scalar_secs, scalar_secs > 0 ? n / scalar_secs : 0.0);
+    printf("%-8s %8.3f sec %12.0f instances/sec (%.1fx)\n", "batch", batch_secs,
+           batch_secs > 0 ? n / batch_secs : 0.0, batch_secs > 0 ? scalar_secs / batch_secs : 0.0);
+    free(r);
+    free(cfgs);
+    free(batch);
+    if(mismatches){
+        fprintf(stderr, "Error: %d of %d instances differ from the scalar engine.\n", mismatches, n);
+        return 1;
+    }
+    printf("All instances match the scalar engine\n");
+    return 0;
+}
+
+/*
+ * Kernel microbenchmark: the stepping kernels against the per-direction loops they
+ * replaced, on the same synthetic traffic for a few escalator lengths.
+ */
+static int kernel_benchmark(long ticks){
+    const int lengths[] = { 1, 4, 8, 12, 13 };
+    int mismatches = 0;
+    printf("===== Kernel Benchmark (%ld ticks per run) =====\n", ticks);
+    printf("%6s %14s %14s %8s\n", "steps", "loops ns/tick", "kernel ns/tick", "speedup");
+    for(int i=0; i<5; i++){
+        double ns[2];
+        long sums[2];
+        for(int legacy=1; legacy>=0; legacy--){
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            sums[legacy] = mallsim_kernel_workload(lengths[i], ticks, legacy);
+            ns[legacy] = elapsed_seconds(&start) * 1e9 / ticks;
+        }
+        if(sums[0] != sums[1]) mismatches++;
+        printf("%6d %14.2f %14.2f %7.2fx%s\n", lengths[i], ns[1], ns[0],
+               ns[0] > 0 ? ns[1] / ns[0] : 0.0, (sums[0] != sums[1]) ? "  MISMATCH" : "");
+    }
+    if(mismatches){
+        fprintf(stderr, "Error: %d lengths moved riders differently from the loops.\n", mismatches);
+        return 1;
+    }
+    return 0;
 }
 
 // --------------------------------------------------
-// Print escalator status
+// Golden traces
 // --------------------------------------------------
-void print_escalator_status(){
-    pthread_mutex_lock(&mall_mutex);
-    Escalator* e = mall->escalator;
-    printf("Escalator status: [");
-    // Only print g_escalator_capacity steps
-    for(int i=0; i<g_escalator_capacity; i++){
-        if(e->steps[i]) {
-            printf("%d", e->steps[i]->id);
-        } else {
-            printf("0");
-        }
-        if(i<g_escalator_capacity-1) printf(",");
+
+// Engines checked against the reference by --golden; a new engine goes here before it replaces one
+static const struct {
+    const char* name;
+    GoldenEngine run;
+} golden_engines[] = {
+    { "mallsim", mallsim_run },
+};
+
+static int golden_traces(int scenarios, unsigned int seed){
+    int failed = 0;
+    for(size_t i=0; i<sizeof(golden_engines) / sizeof(golden_engines[0]); i++){
+        if(i > 0) printf("\n");
+        if(golden_check(golden_engines[i].name, golden_engines[i].run, scenarios, seed)) failed++;
+    }
+    if(failed){
+        fprintf(stderr, "Error: %d engines diverge from the reference.\n", failed);
+        return 1;
     }
-    printf("], Direction: %s\n",
-           (e->direction==UP)?"Up":
-           (e->direction==DOWN)?"Down":"Idle");
-    pthread_mutex_unlock(&mall_mutex);
+    return 0;
 }
 
 // --------------------------------------------------
-// Main loop (no random generation of new customers anymore)
+// Capacity planning
 // --------------------------------------------------
-void mall_control_loop(){
-    while(simulation_running){
-        pthread_mutex_lock(&mall_mutex);
-        printf("\n----- Time: %d sec -----\n", mall->current_time);
-        pthread_mutex_unlock(&mall_mutex);
-
-        // 1. Operate escalator
-        operate_escalator();
-
-        // 2. Print escalator status
-        print_escalator_status();
-
-        // 3. Attempt to board the first customer in the up queue
-        pthread_mutex_lock(&mall_mutex);
-        if(mall->upQueue->head){
-            Customer* c = mall->upQueue->head;
-            pthread_mutex_unlock(&mall_mutex);
-
-            if(can_customer_board(c)){
-                Customer* top = dequeue(mall->upQueue);
-                board_customer(top);
-            } else {
-                pthread_mutex_lock(&mall_mutex);
-                printf("Upward customer %d cannot board the escalator yet\n", c->id);
-                pthread_mutex_unlock(&mall_mutex);
-            }
-        } else {
-            pthread_mutex_unlock(&mall_mutex);
-        }
+static int capacity_plan(const MallConfig* base, const MallPlanSpec* spec){
+    MallPlanResult res;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if(mallsim_plan(base, spec, &res) != 0){
+        fprintf(stderr, "Error: invalid planning parameters.\n");
+        return 1;
+    }
+    double secs = elapsed_seconds(&start);
 
-        // 4. Attempt to board the first customer in the down queue
-        pthread_mutex_lock(&mall_mutex);
-        if(mall->downQueue->head){
-            Customer* c = mall->downQueue->head;
-            pthread_mutex_unlock(&mall_mutex);
-
-            if(can_customer_board(c)){
-                Customer* top = dequeue(mall->downQueue);
-                board_customer(top);
-            } else {
-                pthread_mutex_lock(&mall_mutex);
-                printf("Downward customer %d cannot board the escalator yet\n", c->id);
-                pthread_mutex_unlock(&mall_mutex);
-            }
-        } else {
-            pthread_mutex_unlock(&mall_mutex);
-        }
+    printf("===== Capacity Plan =====\n");
+    printf("Target: wait p99 <= %.1f sec, lost demand <= %.1f%%, 95%% confidence\n",
+           spec->target_p99, 100.0 * spec->max_loss);
+    printf("Arrival profile: %d initial customers, arrivals until %d sec, seeds %u..%u\n",
+           base->initial_customers, base->arrival_seconds, base->seed,
+           base->seed + (unsigned int)spec->replications - 1);
+    if(base->arrival_seconds > 0){
+        printf("Search space: steps %d..%d, mall capacity %d..%d by %d, batch %d..%d\n",
+               spec->steps_min, spec->steps_max, spec->capacity_min, spec->capacity_max,
+               spec->capacity_step, spec->batch_min, spec->batch_max);
+    } else {
+        printf("Search space: steps %d..%d, batch %d..%d (closed mall of %d)\n",
+               spec->steps_min, spec->steps_max, spec->batch_min, spec->batch_max, base->mall_capacity);
+    }
+    if(res.found){
+        printf("Cheapest configuration: steps = %d, mall capacity = %d, batch = %d\n",
+               res.best.escalator_steps, res.best.mall_capacity, res.best.batch_size);
+        printf("  Wait p99 = %.1f sec (95%% CI %.1f .. %.1f, %d runs)\n",
+               res.p99_mean, res.p99_low, res.p99_high, res.replications);
+        printf("  Lost demand = %.2f%% (95%% CI %.2f .. %.2f)\n",
+               100.0 * res.loss_mean, 100.0 * res.loss_low, 100.0 * res.loss_high);
+    } else {
+        printf("No configuration in the search space meets the target with 95%% confidence\n");
+    }
+    printf("Searched %d lengths, %d candidates (%d pruned early), %ld simulations in %.3f sec (%d threads)\n",
+           res.levels, res.candidates, res.pruned, res.runs, secs, spec->threads);
+    return 0;
+}
 
-        // Print status again
-        print_escalator_status();
+// --------------------------------------------------
+// Analytic estimate vs. simulation
+// --------------------------------------------------
 
-        // [Removed Step 5 of original code: no random customers generated anymore]
+typedef struct {
+    double throughput, mean_wait, switch_rate;
+} FlowStats;
 
-        // 6. Print mall status
-        pthread_mutex_lock(&mall_mutex);
-        printf("Mall status: Total customers = %d, upQ = %d, downQ = %d, On escalator = %d\n",
-               mall->total_customers,
-               mall->upQueue->length,
-               mall->downQueue->length,
-               mall->escalator->num_people);
+// Means over 'reps' seeded runs (seed, seed+1, ...); throughput and switches per simulated second
+static FlowStats simulate_flow(const MallConfig* base, int reps, MallResult* r){
+    FlowStats s = { 0.0, 0.0, 0.0 };
+    MallConfig cfg = *base;
+    cfg.log = NULL;
+    for(int i=0; i<reps; i++){
+        cfg.seed = base->seed + (unsigned int)i;
+        run_mall(&cfg, r);
+        s.throughput  += (double)r->completed / r->ticks;
+        s.mean_wait   += r->counters.boarded ? (double)r->total_wait / r->counters.boarded : 0.0;
+        s.switch_rate += (double)r->counters.direction_switches / r->ticks;
+    }
+    s.throughput /= reps;
+    s.mean_wait /= reps;
+    s.switch_rate /= reps;
+    return s;
+}
 
-        // 7. Termination condition: if no more customers remain, end
-        if(mall->total_customers == 0){
-            simulation_running = 0;
-            pthread_mutex_unlock(&mall_mutex);
-            break;
-        }
+static double relative_error(double estimate, double simulated){
+    return simulated > 0 ? (estimate - simulated) / simulated : 0.0;
+}
 
-        mall->current_time++;
-        pthread_mutex_unlock(&mall_mutex);
+static const char* regime_name(int regime){
+    static const char* const names[] = { "closed", "stable", "saturated" };
+    return (regime >= 0 && regime < 3) ? names[regime] : "unknown";
+}
 
-        sleep(1);
+static int estimate_scenario(const MallConfig* cfg, int reps){
+    MallEstimate e;
+    if(mallsim_estimate(cfg, &e) != 0){
+        fprintf(stderr, "Error: the estimate covers a single-lane reversible escalator only, without "
+                "balking, patience, priority classes, outages, breakdowns or a wait bound.\n");
+        return 1;
     }
+    MallResult* r = alloc_results(1);
+    FlowStats s = simulate_flow(cfg, reps, r);
+    free(r);
 
-    printf("\n===== Simulation Ended =====\n");
-    pthread_mutex_lock(&mall_mutex);
-    printf("Remaining customers: %d\n", mall->total_customers);
-    if(completed_customers > 0){
-        double avg = (double)total_turnaround_time / completed_customers;
-        printf("Average turnaround time = %.2f sec\n", avg);
+    printf("===== Analytic Estimate =====\n");
+    printf("Steps: %d, batch: %d, ", cfg->escalator_steps, cfg->batch_size);
+    if(e.regime == MALLSIM_REGIME_CLOSED){
+        printf("closed mall of %d customers\n", cfg->initial_customers);
     } else {
-        printf("No customers completed their ride?\n");
+        printf("0-%d arrivals/sec until %d sec, mall capacity %d\n",
+               cfg->arrival_max, cfg->arrival_seconds, cfg->mall_capacity);
+    }
+    printf("Regime: %s", regime_name(e.regime));
+    if(e.regime != MALLSIM_REGIME_CLOSED){
+        printf(", cycle %.1f sec, %.2f boardings per phase, %.1f%% of arrivals lost",
+               e.cycle, e.batch, 100.0 * e.loss);
     }
-    pthread_mutex_unlock(&mall_mutex);
+    printf("\n");
+    printf("%-28s %12s %12s %10s\n", "", "estimate", "simulated", "error");
+    printf("%-28s %12.3f %12.3f %+9.1f%%\n", "Throughput (customers/sec)",
+           e.throughput, s.throughput, 100.0 * relative_error(e.throughput, s.throughput));
+    printf("%-28s %12.2f %12.2f %+9.1f%%\n", "Mean wait (sec)",
+           e.mean_wait, s.mean_wait, 100.0 * relative_error(e.mean_wait, s.mean_wait));
+    printf("%-28s %12.4f %12.4f %+9.1f%%\n", "Switches per sec",
+           e.switch_rate, s.switch_rate, 100.0 * relative_error(e.switch_rate, s.switch_rate));
+    printf("(simulated: mean of %d seeded runs from seed %u)\n", reps, cfg->seed);
+    return 0;
+}
+
+/*
+ * Benchmark of the estimate: a grid of closed and open scenarios, each simulated over
+ * 'reps' seeds, with the relative error of every estimated quantity, the mean absolute
+ * error per regime, and the cost of an estimate against a simulation.
+ */
+static void estimate_benchmark(const MallConfig* base, int reps){
+    const int steps[] = { 1, 2, 4, 8, 13 };
+    const int batches[] = { 1, 3, 5, 10 };
+    const int loads[] = { 0, 1, 2 };   // arrival_max; 0 = closed mall of 30
+    int num = 5 * 4 * 3;
+    MallConfig* cfgs = (MallConfig*)malloc(sizeof(MallConfig) * num);
+    if(!cfgs){
+        perror("malloc scenarios");
+        exit(EXIT_FAILURE);
+    }
+    int k = 0;
+    for(int l=0; l<3; l++){
+        for(int si=0; si<5; si++){
+            for(int bi=0; bi<4; bi++, k++){
+                MallConfig* c = &cfgs[k];
+                *c = *base;
+                c->log = NULL;
+                c->balk_length = c->patience = c->stairs_time = 0;
+                c->outage_length = c->breakdown_mtbf = c->wait_bound = 0;
+                c->pair = 0;
+                c->lanes = c->classes = 1;
+                c->escalator_steps = steps[si];
+                c->batch_size = batches[bi];
+                c->arrival_max = loads[l];
+                c->initial_customers = loads[l] ? 0 : 30;
+                c->arrival_seconds = loads[l] ? 3600 : 0;
+                c->mall_capacity = 30;
+            }
+        }
+    }
+
+    MallResult* r = alloc_results(1);
+    double err_sum[3][3] = { { 0 } }, err_max[3][3] = { { 0 } };
+    int count[3] = { 0 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    printf("===== Estimate Benchmark (%d seeds per scenario) =====\n", reps);
+    printf("%5s %5s %6s %-9s | %16s %16s %18s\n", "steps", "batch", "load", "regime",
+           "throughput err", "mean wait err", "switch rate err");
+    for(k=0; k<num; k++){
+        MallEstimate e;
+        mallsim_estimate(&cfgs[k], &e);
+        FlowStats s = simulate_flow(&cfgs[k], reps, r);
+        double err[3] = {
+            relative_error(e.throughput, s.throughput),
+            relative_error(e.mean_wait, s.mean_wait),
+            relative_error(e.switch_rate, s.switch_rate)
+        };
+        for(int q=0; q<3; q++){
+            err_sum[e.regime][q] += fabs(err[q]);
+            if(fabs(err[q]) > err_max[e.regime][q]) err_max[e.regime][q] = fabs(err[q]);
+        }
+        count[e.regime]++;
+        char load[8];
+        if(cfgs[k].arrival_max) snprintf(load, sizeof(load), "0-%d/s", cfgs[k].arrival_max);
+        else snprintf(load, sizeof(load), "closed");
+        printf("%5d %5d %6s %-9s | %+15.1f%% %+15.1f%% %+17.1f%%\n",
+               cfgs[k].escalator_steps, cfgs[k].batch_size, load, regime_name(e.regime),
+               100.0 * err[0], 100.0 * err[1], 100.0 * err[2]);
+    }
+    double sim_secs = elapsed_seconds(&start);
+
+    // The estimates alone, repeated until the timing is meaningful
+    const int rounds = 2000;
+    volatile double sink = 0.0;   // Keeps the estimates from being optimised away
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i=0; i<rounds; i++){
+        for(k=0; k<num; k++){
+            MallEstimate e;
+            mallsim_estimate(&cfgs[k], &e);
+            sink += e.mean_wait;
+        }
+    }
+    double est_secs = elapsed_seconds(&start);
+
+    printf("\nMean (max) absolute error by regime:\n");
+    for(int g=0; g<3; g++){
+        if(count[g] == 0) continue;
+        printf("  %-9s %2d scenarios: throughput %5.1f%% (%5.1f%%), mean wait %5.1f%% (%5.1f%%), switches %5.1f%% (%5.1f%%)\n",
+               regime_name(g), count[g],
+               100.0 * err_sum[g][0] / count[g], 100.0 * err_max[g][0],
+               100.0 * err_sum[g][1] / count[g], 100.0 * err_max[g][1],
+               100.0 * err_sum[g][2] / count[g], 100.0 * err_max[g][2]);
+    }
+    printf("Estimate: %.3f us each; simulation: %.1f us per run (%d runs in %.3f sec)\n",
+           est_secs * 1e6 / ((double)rounds * num), sim_secs * 1e6 / ((double)num * reps),
+           num * reps, sim_secs);
+    free(r);
+    free(cfgs);
 }
 
 // --------------------------------------------------
-// Cleanup
+// Cost of a hard wait bound
 // --------------------------------------------------
-void cleanup_resources(){
-    pthread_mutex_lock(&mall_mutex);
-    Customer* c;
-    while( (c=dequeue(mall->upQueue))!=NULL ) free(c);
-    while( (c=dequeue(mall->downQueue))!=NULL ) free(c);
-
-    // Clean up any remaining customers on the escalator
-    for(int i=0; i<13; i++){
-        if(mall->escalator->steps[i]){
-            free(mall->escalator->steps[i]);
+
+typedef struct {
+    long completed, ticks, boarded, wait, switches, holds, cut;
+    int worst_front;
+    int* hist;
+} BoundTotals;
+
+/*
+ * Runs the mall with the batch rule alone and with the wait bound on the same seeds, and
+ * prints what the guarantee costs: throughput, wait, switches and drains.
+ */
+static int wait_bound_cost(const MallConfig* base, int reps){
+    if(base->wait_bound <= 0){
+        fprintf(stderr, "Error: --bound-cost needs --wait-bound <sec>.\n");
+        return 1;
+    }
+    BoundTotals t[2];
+    memset(t, 0, sizeof(t));
+    MallResult* r = alloc_results(1);
+    for(int v=0; v<2; v++){
+        t[v].hist = (int*)calloc(MALLSIM_HIST_BUCKETS, sizeof(int));
+        if(!t[v].hist){
+            perror("malloc histogram");
+            exit(EXIT_FAILURE);
+        }
+        MallConfig cfg = *base;
+        cfg.log = NULL;
+        cfg.flight_log = NULL;
+        cfg.wait_bound = v ? base->wait_bound : 0;
+        for(int i=0; i<reps; i++){
+            cfg.seed = base->seed + (unsigned int)i;
+            run_mall(&cfg, r);
+            t[v].completed += r->completed;
+            t[v].ticks     += r->ticks;
+            t[v].boarded   += r->counters.boarded;
+            t[v].wait      += r->total_wait;
+            t[v].switches  += r->counters.direction_switches;
+            t[v].holds     += r->bound_holds;
+            t[v].cut       += r->bound_switches;
+            if(r->worst_front_wait > t[v].worst_front) t[v].worst_front = r->worst_front_wait;
+            for(int b=0; b<MALLSIM_HIST_BUCKETS; b++) t[v].hist[b] += r->wait_hist[b];
         }
     }
-    free(mall->upQueue);
-    free(mall->downQueue);
-    free(mall->escalator);
-    free(mall);
-    pthread_mutex_unlock(&mall_mutex);
+    free(r);
+
+    double thr[2];
+    char bound_name[32];
+    snprintf(bound_name, sizeof(bound_name), "bound %d s", base->wait_bound);
+    printf("===== Wait Bound Cost =====\n");
+    printf("Steps: %d, batch: %d, initial customers: %d, arrivals until: %d sec, mall capacity: %d, seeds %u..%u\n",
+           base->escalator_steps, base->batch_size, base->initial_customers, base->arrival_seconds,
+           base->mall_capacity, base->seed, base->seed + (unsigned int)reps - 1);
+    printf("%-32s %12s %12s\n", "", "batch rule", bound_name);
+    for(int v=0; v<2; v++) thr[v] = t[v].ticks ? (double)t[v].completed / t[v].ticks : 0.0;
+    printf("%-32s %12.4f %12.4f\n", "Throughput (customers/sec)", thr[0], thr[1]);
+    printf("%-32s %12.2f %12.2f\n", "Mean queue wait (sec)",
+           t[0].boarded ? (double)t[0].wait / t[0].boarded : 0.0,
+           t[1].boarded ? (double)t[1].wait / t[1].boarded : 0.0);
+    printf("%-32s %12d %12d\n", "Queue wait p99 (sec)",
+           mallsim_percentile(t[0].hist, 99), mallsim_percentile(t[1].hist, 99));
+    printf("%-32s %12d %12d\n", "Longest time at the front (sec)", t[0].worst_front, t[1].worst_front);
+    printf("%-32s %12.2f %12.2f\n", "Direction switches per run", (double)t[0].switches / reps, (double)t[1].switches / reps);
+    printf("%-32s %12s %12.2f\n", "Phases cut short per run", "-", (double)t[1].cut / reps);
+    printf("%-32s %12s %12.2f\n", "Boardings held back per run", "-", (double)t[1].holds / reps);
+    printf("Throughput cost of the bound: %.2f%%%s\n",
+           thr[0] > 0 ? 100.0 * (thr[0] - thr[1]) / thr[0] : 0.0,
+           t[1].worst_front <= base->wait_bound ? "" : "  (BOUND VIOLATED)");
+    free(t[0].hist);
+    free(t[1].hist);
+    return t[1].worst_front <= base->wait_bound ? 0 : 1;
 }
 
-int main(int argc, char* argv[]){
-    srand(time(NULL));
+static void usage(const char* prog){
+    fprintf(stderr, "Usage: %s <EscalatorSteps <= 13> <TotalCustomers <= 30> [options]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --seed <n>               Seed of the random streams (default: current time)\n");
+    fprintf(stderr, "  --escalators <k>         Stack k escalators; TotalCustomers is then per escalator\n");
+    fprintf(stderr, "  --threads <n>            Worker threads for a building run (default 1)\n");
+    fprintf(stderr, "  --bench-scaling [max]    Time the building with 1..max threads (default: online CPUs)\n");
+    fprintf(stderr, "  --pair                   Two one-way escalators instead of one reversible escalator\n");
+    fprintf(stderr, "  --arrivals <sec>         Compare mode: 0-2 extra customers per second until <sec> (mall capacity 30)\n");
+    fprintf(stderr, "  --capacity <n>           Mall capacity with --arrivals (default 30)\n");
+    fprintf(stderr, "  --compare-pair           Compare reversible vs. pair on the same seeded arrivals\n");
+    fprintf(stderr, "  --walkers <pct>          Stand right / walk left: <pct>%% of customers walk the left lane\n");
+    fprintf(stderr, "  --walk-speed <max>       Walkers cover 2..<max> steps per second (default 3)\n");
+    fprintf(stderr, "  --compare-batch <list>   Compare batch sizes (e.g. 1,5,10) on common random numbers over --replications seeds\n");
+    fprintf(stderr, "  --compare-lanes          Compare single file vs. --walkers on the same seeded arrivals\n");
+    fprintf(stderr, "  --batch <n>              Boardings per direction before switching to a waiting queue (default 5)\n");
+    fprintf(stderr, "  --plan <sec>             Find the cheapest steps/capacity/batch meeting wait p99 <= <sec>\n");
+    fprintf(stderr, "  --plan-steps <min>:<max> Planning: escalator lengths to consider (default 1:13)\n");
+    fprintf(stderr, "  --plan-loss <pct>        Planning: largest acceptable share of arrivals turned away (default 5)\n");
+    fprintf(stderr, "  --replications <n>       Planning: most runs per candidate; estimates: seeds simulated (default 32);\n");
+    fprintf(stderr, "                           --precision: most replications (default 1000)\n");
+    fprintf(stderr, "  --arrival-max <n>        0..n arrivals per second with --arrivals (default 2)\n");
+    fprintf(stderr, "  --precision <pct>        Replicate until the 95%% intervals of wait and turnaround are within <pct>%% (warm-up cut)\n");
+    fprintf(stderr, "  --steady <pct>           Same from one long run of an open mall (--arrivals is the longest it runs)\n");
+    fprintf(stderr, "  --estimate               Analytic estimate of the configured mall next to the simulated mean\n");
+    fprintf(stderr, "  --estimate-bench         Estimate vs. simulation over a grid of scenarios, with timings\n");
+    fprintf(stderr, "  --priority <pct>:<w>     Add a priority class: <pct>%% of customers, <w> fronts per round (repeatable, up to 3)\n");
+    fprintf(stderr, "  --balk <len>             Customers balk at a queue of at least <len> people\n");
+    fprintf(stderr, "  --patience <sec>         Mean seconds a customer queues before giving up\n");
+    fprintf(stderr, "  --stairs <sec>           Customers who give up take the stairs (takes <sec>) instead of leaving\n");
+    fprintf(stderr, "  --bench-agents <n>       Run n simultaneous customer agents and report their cost\n");
+    fprintf(stderr, "  --bench-kernels <ticks>  Time the stepping kernels against the old per-direction loops\n");
+    fprintf(stderr, "  --bench-runs <n>         Run n seeded evaluations in-process through the library API\n");
+    fprintf(stderr, "  --bench-batch <n>        Run n seeded closed malls through the lockstep batch engine and the scalar one\n");
+    fprintf(stderr, "  --golden <n>             Compare event traces with the reference engine on n scenarios (seeds from --seed)\n");
+    fprintf(stderr, "  --wait-bound <sec>       Guarantee no queue head waits longer than <sec> at the front (>= 2 x steps)\n");
+    fprintf(stderr, "  --bound-cost             Compare the batch rule with and without --wait-bound over --replications seeds\n");
+    fprintf(stderr, "  --outage <start>:<sec>   Stop the escalator at <start> for <sec> seconds\n");
+    fprintf(stderr, "  --breakdowns <mtbf>:<mttr> Random breakdowns: mean seconds between them and to repair\n");
+    fprintf(stderr, "  --flight-wait <sec>      Dump the last ticks to stderr when a queue head has waited <sec>\n");
+    fprintf(stderr, "  --flight-ticks <n>       Ticks kept by the flight recorder (default 64)\n");
+    fprintf(stderr, "  --tick-ms <ms>           Wall-clock length of a tick (default 1000, 0 = unpaced)\n");
+    fprintf(stderr, "  --metrics-file <path>    Publish utilisation counters to <path> (text exposition format)\n");
+    fprintf(stderr, "  --metrics-interval <ms>  How often the metrics file is rewritten (default 1000)\n");
+    fprintf(stderr, "  --records <prefix>       Write per-customer columns to <prefix>.<column> (classic and building runs)\n");
+    fprintf(stderr, "  --window <sec>           Classic run: throughput, queue and occupancy per <sec> seconds, printed at the end\n");
+    fprintf(stderr, "  --profile                Classic run: time (and hardware counters) per phase of the tick, printed at the end\n");
+    fprintf(stderr, "  --window-file <path>     Stream the windows to <path> as CSV instead (default window 60 sec)\n");
+}
 
+int main(int argc, char* argv[]){
     // 1. Parse command line arguments: <EscalatorSteps <= 13>, <TotalCustomers <= 30>
     if(argc < 3){
-        fprintf(stderr, "Usage: %s <EscalatorSteps <= 13> <TotalCustomers <= 30>\n", argv[0]);
+        usage(argv[0]);
         return 1;
     }
 
-    g_escalator_capacity = atoi(argv[1]);
-    if(g_escalator_capacity < 1 || g_escalator_capacity > 13){
+    MallConfig cfg;
+    mallsim_default_config(&cfg);
+    cfg.escalator_steps = atoi(argv[1]);
+    if(cfg.escalator_steps < 1 || cfg.escalator_steps > 13){
         fprintf(stderr, "Error: escalator capacity must be between 1 and 13.\n");
         return 1;
     }
@@ -555,38 +990,311 @@ int main(int argc, char* argv[]){
         fprintf(stderr, "Error: total customers must be between 0 and 30.\n");
         return 1;
     }
-    // Here we set g_mall_capacity to total_cust_to_generate as the mall capacity.
-    g_mall_capacity = total_cust_to_generate;
-    
-    // 2. Initialize recursive mutex and semaphore
-    pthread_mutexattr_t attr;
-    pthread_mutexattr_init(&attr);
-    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-    pthread_mutex_init(&mall_mutex, &attr);
-    pthread_mutexattr_destroy(&attr);
+    // The mall capacity is the number of customers generated, unless arrivals open the mall
+    cfg.initial_customers = total_cust_to_generate;
+    cfg.mall_capacity = total_cust_to_generate;
+    cfg.seed = (unsigned int)time(NULL);
 
-    sem_init(&escalator_capacity_sem, 0, g_escalator_capacity);
+    int tick_ms = 1000;
+    int num_escalators = 0;   // 0 => classic single-escalator run
+    int num_threads = 1;
+    int bench_max_threads = 0;
+    int compare_pair = 0;
+    int compare_walk = 0;
+    int capacity = 0;         // 0 => 30 for an open mall
+    int bench_agents = 0;
+    int bench_runs = 0;
+    int bench_batch = 0;
+    long bench_kernels = 0;
+    int golden = 0;
+    MallPlanSpec plan;
+    mallsim_default_plan(&plan);
+    int planning = 0;
+    int estimating = 0;       // 1 = --estimate, 2 = --estimate-bench
+    int bound_cost = 0;
+    int batch_sizes[16];
+    int num_batch_sizes = 0;  // --compare-batch
+    MallStopSpec stop;
+    mallsim_default_stop(&stop);
+    int stopping = 0;         // 1 = --precision, 2 = --steady
+    for(int i=3; i<argc; i++){
+        if(strcmp(argv[i], "--seed") == 0 && i+1 < argc){
+            cfg.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--escalators") == 0 && i+1 < argc){
+            num_escalators = atoi(argv[++i]);
+            if(num_escalators < 1){
+                fprintf(stderr, "Error: number of escalators must be at least 1.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--threads") == 0 && i+1 < argc){
+            num_threads = atoi(argv[++i]);
+            if(num_threads < 1){
+                fprintf(stderr, "Error: number of threads must be at least 1.\n");
+                return 1;
+            }
+            if(num_escalators == 0) num_escalators = 1;
+        } else if(strcmp(argv[i], "--bench-scaling") == 0){
+            bench_max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if(i+1 < argc && argv[i+1][0] != '-'){
+                bench_max_threads = atoi(argv[++i]);
+            }
+            if(bench_max_threads < 1) bench_max_threads = 1;
+        } else if(strcmp(argv[i], "--tick-ms") == 0 && i+1 < argc){
+            tick_ms = atoi(argv[++i]);
+            if(tick_ms < 0){
+                fprintf(stderr, "Error: tick length must not be negative.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--metrics-file") == 0 && i+1 < argc){
+            g_metrics_path = argv[++i];
+        } else if(strcmp(argv[i], "--metrics-interval") == 0 && i+1 < argc){
+            g_metrics_interval_ms = atoi(argv[++i]);
+            if(g_metrics_interval_ms < 1){
+                fprintf(stderr, "Error: metrics interval must be at least 1 ms.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--records") == 0 && i+1 < argc){
+            g_records_prefix = argv[++i];
+        } else if(strcmp(argv[i], "--window") == 0 && i+1 < argc){
+            g_window = atoi(argv[++i]);
+            if(g_window < 1){
+                fprintf(stderr, "Error: windows must be at least 1 second long.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--window-file") == 0 && i+1 < argc){
+            g_window_path = argv[++i];
+            if(g_window == 0) g_window = 60;
+        } else if(strcmp(argv[i], "--profile") == 0){
+            g_profile = 1;
+        } else if(strcmp(argv[i], "--pair") == 0){
+            cfg.pair = 1;
+        } else if(strcmp(argv[i], "--batch") == 0 && i+1 < argc){
+            cfg.batch_size = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--plan") == 0 && i+1 < argc){
+            plan.target_p99 = atof(argv[++i]);
+            planning = 1;
+        } else if(strcmp(argv[i], "--plan-steps") == 0 && i+1 < argc){
+            if(sscanf(argv[++i], "%d:%d", &plan.steps_min, &plan.steps_max) != 2){
+                fprintf(stderr, "Error: --plan-steps takes <min>:<max>.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--plan-loss") == 0 && i+1 < argc){
+            plan.max_loss = atof(argv[++i]) / 100.0;
+        } else if(strcmp(argv[i], "--replications") == 0 && i+1 < argc){
+            plan.replications = atoi(argv[++i]);
+            if(plan.replications < 2){
+                fprintf(stderr, "Error: at least 2 replications are needed for a confidence interval.\n");
+                return 1;
+            }
+            stop.replications = plan.replications;
+            if(stop.min_replications > stop.replications) stop.min_replications = stop.replications;
+        } else if((strcmp(argv[i], "--precision") == 0 || strcmp(argv[i], "--steady") == 0) && i+1 < argc){
+            stopping = (argv[i][2] == 'p') ? 1 : 2;
+            stop.precision = atof(argv[++i]) / 100.0;
+            if(stop.precision <= 0){
+                fprintf(stderr, "Error: precision must be a positive percentage.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--arrival-max") == 0 && i+1 < argc){
+            cfg.arrival_max = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--estimate") == 0){
+            estimating = 1;
+        } else if(strcmp(argv[i], "--estimate-bench") == 0){
+            estimating = 2;
+        } else if(strcmp(argv[i], "--wait-bound") == 0 && i+1 < argc){
+            cfg.wait_bound = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--bound-cost") == 0){
+            bound_cost = 1;
+        } else if(strcmp(argv[i], "--flight-wait") == 0 && i+1 < argc){
+            cfg.flight_wait = atoi(argv[++i]);
+            cfg.flight_log = print_flight_dump;
+        } else if(strcmp(argv[i], "--flight-ticks") == 0 && i+1 < argc){
+            cfg.flight_ticks = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--priority") == 0 && i+1 < argc){
+            if(cfg.classes == MALLSIM_MAX_CLASSES){
+                fprintf(stderr, "Error: at most %d priority classes.\n", MALLSIM_MAX_CLASSES - 1);
+                return 1;
+            }
+            int k = cfg.classes++;
+            if(sscanf(argv[++i], "%d:%d", &cfg.class_percent[k], &cfg.class_weight[k]) != 2){
+                fprintf(stderr, "Error: --priority takes <pct>:<weight>.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--balk") == 0 && i+1 < argc){
+            cfg.balk_length = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--patience") == 0 && i+1 < argc){
+            cfg.patience = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--stairs") == 0 && i+1 < argc){
+            cfg.stairs_time = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--bench-agents") == 0 && i+1 < argc){
+            bench_agents = atoi(argv[++i]);
+            if(bench_agents < 1){
+                fprintf(stderr, "Error: number of agents must be at least 1.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--bench-runs") == 0 && i+1 < argc){
+            bench_runs = atoi(argv[++i]);
+            if(bench_runs < 1){
+                fprintf(stderr, "Error: number of runs must be at least 1.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--bench-batch") == 0 && i+1 < argc){
+            bench_batch = atoi(argv[++i]);
+            if(bench_batch < 1){
+                fprintf(stderr, "Error: number of instances must be at least 1.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--bench-kernels") == 0 && i+1 < argc){
+            bench_kernels = atol(argv[++i]);
+            if(bench_kernels < 1){
+                fprintf(stderr, "Error: number of ticks must be at least 1.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--golden") == 0 && i+1 < argc){
+            golden = atoi(argv[++i]);
+            if(golden < 1){
+                fprintf(stderr, "Error: number of scenarios must be at least 1.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--compare-batch") == 0 && i+1 < argc){
+            const char* p = argv[++i];
+            num_batch_sizes = 0;
+            while(*p){
+                char* end;
+                long size = strtol(p, &end, 10);
+                if(end == p || size < 1 || num_batch_sizes == 16 || (*end && *end != ',')){
+                    fprintf(stderr, "Error: --compare-batch takes up to 16 batch sizes, e.g. 1,5,10.\n");
+                    return 1;
+                }
+                batch_sizes[num_batch_sizes++] = (int)size;
+                p = *end ? end + 1 : end;
+            }
+            if(num_batch_sizes < 2){
+                fprintf(stderr, "Error: --compare-batch needs at least 2 batch sizes.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--compare-pair") == 0){
+            compare_pair = 1;
+        } else if(strcmp(argv[i], "--capacity") == 0 && i+1 < argc){
+            capacity = atoi(argv[++i]);
+            if(capacity < 1){
+                fprintf(stderr, "Error: mall capacity must be at least 1.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--outage") == 0 && i+1 < argc){
+            if(sscanf(argv[++i], "%d:%d", &cfg.outage_start, &cfg.outage_length) != 2){
+                fprintf(stderr, "Error: --outage takes <start>:<sec>.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--breakdowns") == 0 && i+1 < argc){
+            if(sscanf(argv[++i], "%d:%d", &cfg.breakdown_mtbf, &cfg.breakdown_mttr) != 2){
+                fprintf(stderr, "Error: --breakdowns takes <mtbf>:<mttr>.\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--walkers") == 0 && i+1 < argc){
+            cfg.lanes = 2;
+            cfg.walker_percent = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--walk-speed") == 0 && i+1 < argc){
+            cfg.walk_speed_max = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--compare-lanes") == 0){
+            compare_walk = 1;
+        } else if(strcmp(argv[i], "--arrivals") == 0 && i+1 < argc){
+            cfg.arrival_seconds = atoi(argv[++i]);
+            if(cfg.arrival_seconds < 0){
+                fprintf(stderr, "Error: arrival time must not be negative.\n");
+                return 1;
+            }
+            // An open mall admits up to 30 people, like sample7
+            cfg.mall_capacity = 30;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
-    // 3. Initialize mall
-    mall = init_mall();
+    if(capacity > 0 && cfg.arrival_seconds > 0){
+        cfg.mall_capacity = capacity;
+    }
 
-    // 4. Create fixed number of customer threads
-    for(int i=0; i<total_cust_to_generate; i++){
-        int dir = (rand() % 2 == 0) ? UP : DOWN;
-        create_customer(dir);
-        
-        // Give threads some time (not strictly necessary, but used in original)
-        usleep(10000);
+    const char* err = mallsim_check_config(&cfg);
+    if(err){
+        fprintf(stderr, "Error: %s.\n", err);
+        return 1;
     }
 
-    // 5. Main loop
-    mall_control_loop();
+    if(bench_agents > 0){
+        agent_scaling_benchmark(&cfg, bench_agents);
+        return 0;
+    }
+
+    if(bench_kernels > 0){
+        return kernel_benchmark(bench_kernels);
+    }
+
+    if(golden > 0){
+        return golden_traces(golden, cfg.seed);
+    }
+
+    if(bench_batch > 0){
+        return batch_benchmark(&cfg, bench_batch);
+    }
+
+    if(bench_runs > 0){
+        library_run_benchmark(&cfg, bench_runs);
+        return 0;
+    }
+
+    if(bound_cost){
+        return wait_bound_cost(&cfg, plan.replications);
+    }
 
-    // 6. Cleanup
-    sleep(1);
-    cleanup_resources();
-    sem_destroy(&escalator_capacity_sem);
-    pthread_mutex_destroy(&mall_mutex);
+    if(stopping){
+        stop.threads = num_threads;
+        return run_to_precision(&cfg, &stop, stopping == 2);
+    }
+
+    if(estimating){
+        if(estimating == 2){
+            estimate_benchmark(&cfg, plan.replications);
+            return 0;
+        }
+        return estimate_scenario(&cfg, plan.replications);
+    }
+
+    if(planning){
+        plan.threads = num_threads;
+        return capacity_plan(&cfg, &plan);
+    }
+
+    if(num_batch_sizes > 0){
+        return compare_batch_sizes(&cfg, batch_sizes, num_batch_sizes, plan.replications, num_threads);
+    }
+
+    if(compare_pair){
+        compare_escalator_pair(&cfg);
+        return 0;
+    }
+
+    if(compare_walk){
+        if(cfg.lanes != 2){
+            fprintf(stderr, "Error: --compare-lanes needs --walkers <pct>.\n");
+            return 1;
+        }
+        compare_lanes(&cfg);
+        return 0;
+    }
+
+    // Building runs use virtual time and only print their summary
+    if(bench_max_threads > 0 || num_escalators > 0){
+        if(num_escalators == 0) num_escalators = 256;
+        if(bench_max_threads > 0){
+            return building_scaling_benchmark(&cfg, num_escalators, total_cust_to_generate, bench_max_threads);
+        }
+        building_simulation(&cfg, num_escalators, total_cust_to_generate, num_threads);
+        return 0;
+    }
 
+    // 2. Classic run: create the customers and run the paced main loop
+    classic_simulation(&cfg, tick_ms);
     return 0;
 }
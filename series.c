@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "series.h"
+
+WindowSeries* open_window_series(const char* path){
+    WindowSeries* s = (WindowSeries*)calloc(1, sizeof(WindowSeries));
+    if(!s){
+        perror("malloc window series");
+        exit(EXIT_FAILURE);
+    }
+    if(path){
+        s->csv = fopen(path, "w");
+        if(!s->csv){
+            perror(path);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(s->csv, "start,ticks,arrivals,completed_up,completed_down,"
+                        "mean_up_queue,max_up_queue,mean_down_queue,max_down_queue,occupancy\n");
+        fflush(s->csv);
+    }
+    return s;
+}
+
+void add_window(void* user, const MallWindow* w){
+    WindowSeries* s = (WindowSeries*)user;
+    if(s->csv){
+        // A line per window, flushed so that the file can be followed while the run goes on
+        fprintf(s->csv, "%d,%d,%d,%d,%d,%.3f,%d,%.3f,%d,%.4f\n",
+                w->start, w->ticks, w->arrivals, w->completed_up, w->completed_down,
+                w->mean_up_queue, w->max_up_queue, w->mean_down_queue, w->max_down_queue, w->occupancy);
+        fflush(s->csv);
+        return;
+    }
+    if(s->count == s->capacity){
+        s->capacity = s->capacity ? 2 * s->capacity : 256;
+        s->rows = (MallWindow*)realloc(s->rows, sizeof(MallWindow) * s->capacity);
+        if(!s->rows){
+            perror("malloc window series");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->rows[s->count++] = *w;
+}
+
+void close_window_series(WindowSeries* s, int window){
+    if(s->csv){
+        fclose(s->csv);
+    } else {
+        printf("\n===== Time Series (%d sec windows) =====\n", window);
+        printf("%8s %5s %8s %8s %9s %16s %18s %9s\n", "start", "secs", "arrivals", "up done",
+               "down done", "up queue avg/max", "down queue avg/max", "occupied");
+        for(int i=0; i<s->count; i++){
+            const MallWindow* w = &s->rows[i];
+            printf("%8d %5d %8d %8d %9d %10.1f/%-5d %12.1f/%-5d %8.1f%%\n",
+                   w->start, w->ticks, w->arrivals, w->completed_up, w->completed_down,
+                   w->mean_up_queue, w->max_up_queue, w->mean_down_queue, w->max_down_queue,
+                   100.0 * w->occupancy);
+        }
+    }
+    free(s->rows);
+    free(s);
+}
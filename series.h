@@ -0,0 +1,29 @@
+#ifndef SERIES_H
+#define SERIES_H
+
+#include <stdio.h>
+
+#include "mallsim.h"
+
+/*
+ * Collects the time series of a run (MallConfig.windows): either streamed to a CSV file
+ * a line per window as each one completes, or kept (a MallWindow per window) and printed
+ * as a table once the run is over.
+ */
+typedef struct {
+    FILE* csv;                // NULL => keep the windows for print_window_series
+    MallWindow* rows;
+    int count;
+    int capacity;
+} WindowSeries;
+
+// path NULL => keep the windows in memory
+WindowSeries* open_window_series(const char* path);
+
+// MallWindowFn: pass the series as MallConfig.windows_user
+void add_window(void* user, const MallWindow* window);
+
+// Prints the kept windows (if any), closes the file and frees the series
+void close_window_series(WindowSeries* s, int window);
+
+#endif
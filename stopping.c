@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stopping.h"
+
+int run_to_precision(const MallConfig* cfg, const MallStopSpec* spec, int steady){
+    MallStopResult res;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = steady ? mallsim_steady_run(cfg, spec, &res) : mallsim_replicate(cfg, spec, &res);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if(rc != 0){
+        fprintf(stderr, "Error: %s, or out of memory.\n", steady ? "a steady-state run needs an open mall (arrivals)"
+                                                              : "invalid stopping parameters");
+        return 1;
+    }
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("===== %s =====\n", steady ? "Steady State (one long run)" : "Replications");
+    printf("Target: 95%% half-width <= %.1f%% of the mean\n", 100.0 * spec->precision);
+    if(!res.estimated){
+        printf("Not enough data for an estimate: the run never settled after %ld simulated seconds\n", res.ticks);
+        return 1;
+    }
+    printf("Warm-up cut: %d sec (%ld customers)\n", res.warmup, res.discarded);
+    printf("Average wait = %.2f sec +- %.2f\n", res.wait_mean, res.wait_half);
+    printf("Average turnaround = %.2f sec +- %.2f\n", res.turnaround_mean, res.turnaround_half);
+    printf("%s after %d %s, %ld customers kept, %ld sec simulated, %.3f sec\n",
+           res.converged ? "Converged" : "Did not converge", res.runs,
+           res.runs == 1 ? "run" : "runs", res.observations, res.ticks, secs);
+    if(steady){
+        printf("Intervals from %d batch means\n", res.batches);
+    }
+    return res.converged ? 0 : 1;
+}
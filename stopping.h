@@ -0,0 +1,13 @@
+#ifndef STOPPING_H
+#define STOPPING_H
+
+#include "mallsim.h"
+
+/*
+ * Runs a mall until its mean wait and turnaround are known to spec->precision
+ * (mallsim_replicate, or mallsim_steady_run when steady is set) and prints the estimates,
+ * the warm-up cut and what it took to get there.
+ */
+int run_to_precision(const MallConfig* cfg, const MallStopSpec* spec, int steady);
+
+#endif